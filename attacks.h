@@ -14,15 +14,20 @@ typedef enum Slider {
 } Slider;
 
 // https://www.chessprogramming.org/Magic_Bitboards
+// Indexed with pext, or with fancy magics when built with NO_PEXT for CPUs where pext is microcoded
 typedef struct SliderAttacks {
-    Bitboard *attacks;
+    const Bitboard *attacks;
     Bitboard mask;
+#ifdef NO_PEXT // Kept out of the pext build so that each entry stays 16 bytes
+    Bitboard magic;
+    uint8_t shift;
+#endif
 } SliderAttacks;
 
 
-extern Bitboard pawnAttacks[COLOURS][SQUARES];
-extern Bitboard nonSliderAttacks[NON_SLIDERS][SQUARES]; // Does not include pawns
-extern SliderAttacks sliderAttacks[SLIDERS][SQUARES]; // Does not include the queen
+extern const Bitboard pawnAttacks[COLOURS][SQUARES];
+extern const Bitboard nonSliderAttacks[NON_SLIDERS][SQUARES]; // Does not include pawns
+extern const SliderAttacks sliderAttacks[SLIDERS][SQUARES]; // Does not include the queen
 
 static inline Bitboard getPawnAttacks(Colour c, Square sq) {
     return pawnAttacks[c][sq];
@@ -33,10 +38,18 @@ static inline Bitboard getNonSliderAttacks(NonSlider nonSlider, Square sq) {
     return nonSliderAttacks[nonSlider][sq];
 }
 
+static inline uint64_t getSliderIndex(const SliderAttacks *sa, Bitboard occupied) {
+#ifdef NO_PEXT
+    return (occupied & sa->mask) * sa->magic >> sa->shift;
+#else
+    return pext(occupied, sa->mask);
+#endif
+}
+
 // Does not include queen attacks
 static inline Bitboard getSliderAttacks(Slider slider, Bitboard occupied, Square sq) {
     const SliderAttacks *sa = &sliderAttacks[slider][sq];
-    return sa->attacks[pext(occupied, sa->mask)];
+    return sa->attacks[getSliderIndex(sa, occupied)];
 }
 
 static inline Bitboard getAttacks(PieceType pt, Bitboard occupied, Square sq) {
@@ -47,6 +60,4 @@ static inline Bitboard getAttacks(PieceType pt, Bitboard occupied, Square sq) {
          :                getNonSliderAttacks(KING_NON_SLIDER, sq);
 }
 
-void initializeAttacks();
-
 #endif
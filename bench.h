@@ -0,0 +1,13 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "utility.h"
+
+constexpr Depth BENCH_DEPTH = 11;
+
+// Searches a fixed set of positions to a fixed depth, the total node count is a signature of the search
+void bench(Depth depth);
+// Shared by the command line and UCI bench: nullptr gives BENCH_DEPTH, anything else is clamped to [1, MAX_DEPTH]
+Depth parseBenchDepth(const char *depth);
+
+#endif
@@ -1,23 +1,11 @@
-#include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include "chess_board.h"
 #include "utility.h"
 #include "move_generator.h"
 #include "nnue.h"
 #include "attacks.h"
 
-typedef struct Zobrist {
-    uint64_t pieceOnSquare[PIECE_TYPES * COLOURS][SQUARES]; // TODO: Some unnecessary space due to NO_PIECE
-    uint64_t castlingRights[ALL_RIGHTS + 1]; // +1 to include ALL_RIGHTS
-    uint64_t enPassant[FILES];
-    uint64_t sideToMove;
-} Zobrist;
-
-static Zobrist zobristHashes;
-
-Bitboard fullLine[SQUARES][SQUARES];
-Bitboard inBetweenLine[SQUARES][SQUARES];
-
 // Bit representation: 1s represent the castling rights to stay on, 0s represent the castling rights to turn off
 constexpr CastlingRights CASTLING_RIGHTS_MASK[SQUARES] = {
     [A1] = BLACK_RIGHTS | WHITE_KINGSIDE, [B1] = ALL_RIGHTS, [C1] = ALL_RIGHTS, [D1] = ALL_RIGHTS, [E1] = BLACK_RIGHTS, [F1] = ALL_RIGHTS, [G1] = ALL_RIGHTS, [H1] = BLACK_RIGHTS | WHITE_QUEENSIDE,
@@ -52,28 +40,8 @@ static inline void removePiece(ChessBoard *restrict board, Colour c, PieceType p
     board->pieces[c][ALL_PIECES] ^= sqBB;
 }
 
-static void initializeZobrist() {
-    uint64_t seed = 1070372;
-    for (PieceType pt = PAWN; pt < PIECE_TYPES; pt++) {
-        for (Square sq = 0; sq < SQUARES; sq++) {
-            zobristHashes.pieceOnSquare[pt][sq] = random64BitNumber(&seed);
-            zobristHashes.pieceOnSquare[pt + COLOUR_OFFSET][sq] = random64BitNumber(&seed);
-        }
-    }
-
-    for (CastlingRights cr = 0; cr < ALL_RIGHTS + 1; cr++) {
-        zobristHashes.castlingRights[cr] = random64BitNumber(&seed);
-    }
-
-    for (File file = FILE_A; file < FILES; file++) {
-        zobristHashes.enPassant[file] = random64BitNumber(&seed);
-    }
-
-    zobristHashes.sideToMove = random64BitNumber(&seed);
-}
-
 static bool fiftyMoveRule(const ChessBoard *restrict board) {
-    return board->history->halfmoveClock > 99 && (!getCheckers(board) || anyLegalMoves(board));
+    return getHistory(board)->halfmoveClock > 99 && (!getCheckers(board) || anyLegalMoves(board));
 }
 
 static Bitboard getPinnedPieces(const ChessBoard *restrict board) {
@@ -109,38 +77,7 @@ static Bitboard attackersTo(const ChessBoard *restrict board, Square sq, Colour
          | (getNonSliderAttacks(KING_NON_SLIDER, sq) &  getPieces(board, enemy, KING));
 }
 
-void initializeChessBoard() {
-    initializeZobrist();
-    for (Square sq1 = 0; sq1 < SQUARES; sq1++) {
-        int sq1Rank = squareToRank(sq1);
-        int sq1File = squareToFile(sq1);
-        Bitboard sq1BB = squareToBitboard(sq1);
-        Bitboard sq1BishopAttacks = getSliderAttacks(BISHOP_SLIDER, 0, sq1);
-        Bitboard rankBB = rankBitboardOfSquare(sq1);
-        Bitboard fileBB = fileBitboardOfSquare(sq1);
-        
-        for (Square sq2 = sq1 + 1; sq2 < SQUARES; sq2++) {
-            Bitboard sq2BB = squareToBitboard(sq2);
-            int rankDistance = abs((int) squareToRank(sq2) - sq1Rank);
-            int fileDistance = abs((int) squareToFile(sq2) - sq1File);
-            Bitboard line = 0;
-            Bitboard inBetween = sq1BB | sq2BB;
-            if (rankDistance == 0 || fileDistance == 0) {
-                line = rankDistance == 0 ? rankBB : fileBB;
-                inBetween |= (getSliderAttacks(ROOK_SLIDER, sq2BB, sq1) & getSliderAttacks(ROOK_SLIDER, sq1BB, sq2));
-            } else if (rankDistance == fileDistance) {
-                line = (sq1BishopAttacks & getSliderAttacks(BISHOP_SLIDER, 0, sq2)) | sq1BB | sq2BB;
-                inBetween |= (getSliderAttacks(BISHOP_SLIDER, sq2BB, sq1) & getSliderAttacks(BISHOP_SLIDER, sq1BB, sq2));  
-            }
-            fullLine[sq1][sq2] = line;
-            fullLine[sq2][sq1] = line;
-            inBetweenLine[sq1][sq2] = inBetween;
-            inBetweenLine[sq2][sq1] = inBetween;
-        }
-    }
-}
-
-void parseFEN(ChessBoard *restrict board, ChessBoardHistory *restrict history, Accumulator *restrict accumulator, const char *restrict fen) {
+void parseFEN(ChessBoard *restrict board, Accumulator *restrict accumulator, const char *restrict fen) {
     static const Colour CHAR_TO_COLOUR[128] = {
         ['P'] = WHITE, ['p'] = BLACK, 
         ['N'] = WHITE, ['n'] = BLACK, 
@@ -164,18 +101,19 @@ void parseFEN(ChessBoard *restrict board, ChessBoardHistory *restrict history, A
         ['-'] = 0
     };
 
+    // The rest of the history stack is always written before it is read, so only the first entry is cleared
+    board->historyPly = 0;
+    memset(board->pieces, 0, sizeof(board->pieces));
+    memset(board->pieceTypes, 0, sizeof(board->pieceTypes));
+    ChessBoardHistory *history = &board->history[0];
     *history = (ChessBoardHistory) {0};
-    *board   = (ChessBoard       ) {0};
 
-    accumulatorReset(accumulator); // TODO: Could this be done somewhere else?
-    board->history = history;
     /* 1) Piece Placement */
     Square sq = A8;
     while (*fen != ' ') {
         unsigned char ch = *fen++;
         if (ch > 'A') {
             addPiece(board, CHAR_TO_COLOUR[ch], CHAR_TO_PIECE_TYPE[ch], sq);
-            accumulatorAdd(accumulator, CHAR_TO_COLOUR[ch], CHAR_TO_PIECE_TYPE[ch], sq);
             history->positionKey ^= zobristHashes.pieceOnSquare[CHAR_TO_PIECE_TYPE[ch] + COLOUR_OFFSET * CHAR_TO_COLOUR[ch]][sq++];
         } else if (ch > '/') {
             sq += ch - '0';
@@ -214,6 +152,12 @@ void parseFEN(ChessBoard *restrict board, ChessBoardHistory *restrict history, A
     /* 7) Miscellaneous Data */
     history->checkers = attackersTo(board, getKingSquare(board, board->sideToMove), board->sideToMove, getOccupiedSquares(board));
     history->pinnedPieces = getPinnedPieces(board);
+
+    if (accumulator) refreshAccumulator(board, accumulator);
+}
+
+void refreshAccumulator(const ChessBoard *restrict board, Accumulator *restrict accumulator) {
+    accumulatorRefresh(accumulator, board->pieces);
 }
 
 void getFEN(const ChessBoard *restrict board, char *restrict destination) {
@@ -246,26 +190,26 @@ void getFEN(const ChessBoard *restrict board, char *restrict destination) {
     *destination++ = ' ';
 
     /* 3) Castling Ability */
-    if (board->history->castlingRights) {
+    if (getHistory(board)->castlingRights) {
         for (CastlingRights cr = WHITE_KINGSIDE; cr <= BLACK_QUEENSIDE; cr <<= 1)
-            if (board->history->castlingRights & cr)
-                *destination++ = CASTLING_RIGHTS_TO_CHAR[board->history->castlingRights & cr];
+            if (getHistory(board)->castlingRights & cr)
+                *destination++ = CASTLING_RIGHTS_TO_CHAR[getHistory(board)->castlingRights & cr];
     } else {
         *destination++ = '-';
     }
     *destination++ = ' ';
 
     /* 4) En Passant Target Square */
-    if (board->history->enPassant != NO_SQUARE) {
-        *destination++ = SQUARE_NAME[board->history->enPassant][0];
-        *destination++ = SQUARE_NAME[board->history->enPassant][1];
+    if (getHistory(board)->enPassant != NO_SQUARE) {
+        *destination++ = SQUARE_NAME[getHistory(board)->enPassant][0];
+        *destination++ = SQUARE_NAME[getHistory(board)->enPassant][1];
     } else {
         *destination++ = '-';
     }
     *destination++ = ' ';
 
     /* 5) Halfmove Clock */
-    int halfmoveClock = board->history->halfmoveClock;
+    int halfmoveClock = getHistory(board)->halfmoveClock;
     char helper[8];
     int i = 0;
     helper[i++] = '0' + halfmoveClock % 10;
@@ -290,62 +234,51 @@ void getFEN(const ChessBoard *restrict board, char *restrict destination) {
     *destination = '\0';
 }
 
-void makeNullMove(ChessBoard *restrict board, ChessBoardHistory *restrict newState) {
-    newState->previous       = board->history;
+void makeNullMove(ChessBoard *restrict board) {
+    ChessBoardHistory *newState = &board->history[board->historyPly + 1];
     newState->positionKey    = getEnPassant(board) != NO_SQUARE ? getPositionKey(board) ^ zobristHashes.enPassant[squareToFile(getEnPassant(board))] : getPositionKey(board);
     newState->positionKey   ^= zobristHashes.sideToMove;
-    newState->castlingRights = board->history->castlingRights;
+    newState->castlingRights = getHistory(board)->castlingRights;
     newState->halfmoveClock  = 0;
     newState->enPassant      = NO_SQUARE;
     newState->checkers       = 0;
 
-    board->history = newState;
+    board->historyPly++;
     board->sideToMove ^= 1;
     newState->pinnedPieces = getPinnedPieces(board);
 }
 
-void makeMove(ChessBoard *restrict board, ChessBoardHistory *restrict newState, Accumulator *restrict accumulator, Move move) {
+// The key of the new position is computed before the board is updated so that the transposition table
+// bucket can be prefetched while the accumulator, checkers and pinned pieces are computed.
+// Always inlined so that updateAccumulator is a constant and the board only variant has no accumulator code
+[[gnu::always_inline]] static inline void doMove(ChessBoard *restrict board, Accumulator *restrict accumulator, const TT *restrict tt, Move move, bool updateAccumulator) {
     Square fromSquare = getFromSquare(move);
     Square   toSquare = getToSquare  (move);
     MoveType moveType = getMoveType  (move);
     Colour stm = board->sideToMove, enemy = board->sideToMove ^ 1;
     Square captureSquare = moveType & EN_PASSANT ? moveSquareInDirection(toSquare, stm ? NORTH : SOUTH) : toSquare;
     PieceType colOffset = COLOUR_OFFSET * stm, fromPiece = board->pieceTypes[fromSquare];
+    PieceType toPiece = moveType & PROMOTION ? KNIGHT + (moveType & PROMOTION_PIECE_MASK) : fromPiece;
+    bool isKingSideCastle = toSquare > fromSquare;
+    Square rookFromSquare = isKingSideCastle ? moveSquareInDirection(toSquare  , EAST) : moveSquareInDirection(toSquare  , WEST + WEST);
+    Square rookToSquare   = isKingSideCastle ? moveSquareInDirection(fromSquare, EAST) : moveSquareInDirection(fromSquare, WEST       );
 
-    newState->previous       = board->history;
+    ChessBoardHistory *newState = &board->history[board->historyPly + 1];
     newState->positionKey    = getEnPassant(board) != NO_SQUARE ? getPositionKey(board) ^ zobristHashes.enPassant[squareToFile(getEnPassant(board))] : getPositionKey(board);
     newState->capturedPiece  = board->pieceTypes[captureSquare];
-    newState->castlingRights = board->history->castlingRights;
-    newState->halfmoveClock  = fromPiece == PAWN ? 0 : board->history->halfmoveClock + 1;
+    newState->castlingRights = getHistory(board)->castlingRights;
+    newState->halfmoveClock  = fromPiece == PAWN ? 0 : getHistory(board)->halfmoveClock + 1;
 
+    /* 1) Position Key */
     if (newState->capturedPiece) {
-        removePiece(board, enemy, newState->capturedPiece, captureSquare);
-        accumulatorSub(accumulator, enemy, newState->capturedPiece, captureSquare);
         newState->positionKey ^= zobristHashes.pieceOnSquare[newState->capturedPiece + COLOUR_OFFSET * enemy][captureSquare];
         newState->halfmoveClock = 0;
     } else if (moveType == CASTLE) {
-        bool isKingSideCastle = toSquare > fromSquare;
-        Square rookFromSquare = isKingSideCastle ? moveSquareInDirection(toSquare  , EAST) : moveSquareInDirection(toSquare  , WEST + WEST);
-        Square rookToSquare   = isKingSideCastle ? moveSquareInDirection(fromSquare, EAST) : moveSquareInDirection(fromSquare, WEST       );
-        movePiece(board, stm, ROOK, rookFromSquare, rookToSquare);
-        accumulatorAddSub(accumulator, stm, ROOK, rookFromSquare, rookToSquare);
         newState->positionKey ^= zobristHashes.pieceOnSquare[ROOK + colOffset][rookFromSquare] 
                               ^  zobristHashes.pieceOnSquare[ROOK + colOffset][rookToSquare  ];
     }
-
-    if (moveType & PROMOTION) {
-        PieceType pt = KNIGHT + (moveType & PROMOTION_PIECE_MASK);
-        newState->positionKey ^= zobristHashes.pieceOnSquare[PAWN + colOffset][fromSquare] 
-                              ^  zobristHashes.pieceOnSquare[pt   + colOffset][toSquare  ];
-        removePiece(board, stm, PAWN, fromSquare);
-        addPiece(board, stm, pt, toSquare);
-        accumulatorAddSubPromotion(accumulator, stm, pt, fromSquare, toSquare);
-    } else {
-        movePiece(board, stm, fromPiece, fromSquare, toSquare);
-        accumulatorAddSub(accumulator, stm, fromPiece, fromSquare, toSquare);
-        newState->positionKey ^= zobristHashes.pieceOnSquare[fromPiece + colOffset][fromSquare] 
-                              ^  zobristHashes.pieceOnSquare[fromPiece + colOffset][toSquare  ];
-    }
+    newState->positionKey ^= zobristHashes.pieceOnSquare[fromPiece + colOffset][fromSquare] 
+                          ^  zobristHashes.pieceOnSquare[toPiece   + colOffset][toSquare  ];
 
     if (newState->castlingRights) {
         newState->positionKey ^= zobristHashes.castlingRights[newState->castlingRights];
@@ -358,23 +291,56 @@ void makeMove(ChessBoard *restrict board, ChessBoardHistory *restrict newState,
     } else {
         newState->enPassant = NO_SQUARE;
     }
+    newState->positionKey ^= zobristHashes.sideToMove;
+    if (tt) prefetchTranspositionTable(tt, newState->positionKey);
 
-    board->history = newState;
+    /* 2) Pieces and Accumulator */
+    if (updateAccumulator) resetDirtyPieces(accumulator);
+    if (newState->capturedPiece) {
+        removePiece(board, enemy, newState->capturedPiece, captureSquare);
+        if (updateAccumulator) addDirtyPiece(accumulator, enemy, newState->capturedPiece, captureSquare, NO_SQUARE);
+    } else if (moveType == CASTLE) {
+        movePiece(board, stm, ROOK, rookFromSquare, rookToSquare);
+        if (updateAccumulator) addDirtyPiece(accumulator, stm, ROOK, rookFromSquare, rookToSquare);
+    }
+
+    if (moveType & PROMOTION) {
+        removePiece(board, stm, PAWN, fromSquare);
+        addPiece(board, stm, toPiece, toSquare);
+        if (updateAccumulator) {
+            addDirtyPiece(accumulator, stm, PAWN, fromSquare, NO_SQUARE);
+            addDirtyPiece(accumulator, stm, toPiece, NO_SQUARE, toSquare);
+        }
+    } else {
+        movePiece(board, stm, fromPiece, fromSquare, toSquare);
+        if (updateAccumulator) addDirtyPiece(accumulator, stm, fromPiece, fromSquare, toSquare);
+        if (updateAccumulator && fromPiece == KING) markKingMove(accumulator, stm, fromSquare, toSquare);
+    }
+
+    /* 3) Miscellaneous Data */
+    board->historyPly++;
     board->sideToMove ^= 1;
     board->ply++;
-    newState->positionKey ^= zobristHashes.sideToMove;
     newState->checkers = attackersTo(board, getKingSquare(board, enemy), enemy, getOccupiedSquares(board));
     newState->pinnedPieces = getPinnedPieces(board);
 }
 
+void makeMove(ChessBoard *restrict board, Accumulator *restrict accumulator, const TT *restrict tt, Move move) {
+    doMove(board, accumulator, tt, move, true);
+}
+
+void makeBoardMove(ChessBoard *restrict board, Move move) {
+    doMove(board, nullptr, nullptr, move, false);
+}
+
 void undoMove(ChessBoard *restrict board, Move move) {
     Square fromSquare = getFromSquare(move);
     Square   toSquare = getToSquare  (move);
     MoveType moveType = getMoveType  (move);
     Colour stm = board->sideToMove ^= 1;
-    PieceType capturedPiece = board->history->capturedPiece;
+    PieceType capturedPiece = getHistory(board)->capturedPiece;
 
-    board->history = board->history->previous;
+    board->historyPly--;
     board->ply--;
     
     if (moveType & PROMOTION) {
@@ -395,9 +361,14 @@ void undoMove(ChessBoard *restrict board, Move move) {
     } 
 }
 
+void discardIrreversibleHistory(ChessBoard *restrict board) {
+    int kept = min(getHistory(board)->halfmoveClock, board->historyPly);
+    memmove(board->history, &board->history[board->historyPly - kept], (kept + 1) * sizeof(ChessBoardHistory));
+    board->historyPly = kept;
+}
+
 // TODO: Threefold repetition, greater or equal to 8
 // TODO: Stalemate
-// TODO: Null pointer checks needed if the previous positions are not there such as setting FEN to not start
 bool isDraw(const ChessBoard *restrict board) {
     return fiftyMoveRule(board) || insufficientMaterial(board) || isRepetition(board);
 }
@@ -433,7 +404,7 @@ bool isLegalMove(const ChessBoard *restrict board, Move move) {
         return !attackersTo(board, toSquare, stm, getOccupiedSquares(board) ^ fromSquareBB);
     }
     
-    return !(board->history->pinnedPieces & fromSquareBB) || fullLine[fromSquare][toSquare] & squareToBitboard(kingSquare);
+    return !(getHistory(board)->pinnedPieces & fromSquareBB) || fullLine[fromSquare][toSquare] & squareToBitboard(kingSquare);
 }
 
 // TODO: Need to find minimum validation to assert correctness
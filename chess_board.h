@@ -4,12 +4,15 @@
 #include <stdint.h>
 #include "utility.h"
 #include "nnue.h"
+#include "transposition_table.h"
 
-// Uses a linked list to keep track of the history of the game. 
+// Positions since the last irreversible game move plus the deepest search line, see discardIrreversibleHistory
+constexpr int MAX_HISTORY = 1024;
+
+// One entry per position in the history stack of the board.
 // Maintains information that is lost when a move is made but also
 // information that is expensive to compute so instead of recomputing it is saved. 
 typedef struct ChessBoardHistory {
-    struct ChessBoardHistory *previous; // TODO: Consider making it an array in the struct, or pointer that is sequential
     Key positionKey;
     Bitboard checkers;
     Bitboard pinnedPieces;
@@ -19,30 +22,60 @@ typedef struct ChessBoardHistory {
     uint8_t halfmoveClock; // TODO: Maybe the type
 } ChessBoardHistory;
 
+// The history is a contiguous stack indexed by historyPly, so copying the board copies the whole game
 typedef struct ChessBoard {
-    ChessBoardHistory *history;
     Bitboard pieces[COLOURS][PIECE_TYPES];
     PieceType pieceTypes[SQUARES];
     Colour sideToMove;
     uint16_t ply; // TODO: Maybe the type
+    uint16_t historyPly; // The current position, history[0] is the position that was parsed
+    ChessBoardHistory history[MAX_HISTORY];
 } ChessBoard;
 
+typedef struct Zobrist {
+    uint64_t pieceOnSquare[PIECE_TYPES * COLOURS][SQUARES]; // TODO: Some unnecessary space due to NO_PIECE
+    uint64_t castlingRights[ALL_RIGHTS + 1]; // +1 to include ALL_RIGHTS
+    uint64_t enPassant[FILES];
+    uint64_t sideToMove;
+} Zobrist;
+
+extern const Zobrist zobristHashes;
+
+constexpr int CUCKOO_SIZE = 8192;
+constexpr int CUCKOO_MOVES = 3668; // The number of reversible non pawn moves on an empty board, for both colours
+
+// The key difference and the move of every reversible move, found in O(1) to detect upcoming repetitions
+extern const Key cuckooKeys[CUCKOO_SIZE];
+extern const Move cuckooMoves[CUCKOO_SIZE];
+
+static inline int cuckooHash1(Key key) {
+    return key & (CUCKOO_SIZE - 1);
+}
+
+static inline int cuckooHash2(Key key) {
+    return key >> 16 & (CUCKOO_SIZE - 1);
+}
+
 // Indexing the same square will return 0. Example: fullLine[e4][e4] == 0
-extern Bitboard fullLine[SQUARES][SQUARES];
+extern const Bitboard fullLine[SQUARES][SQUARES];
 
 // Includes the endpoints as well
-extern Bitboard inBetweenLine[SQUARES][SQUARES];
+extern const Bitboard inBetweenLine[SQUARES][SQUARES];
+
+static inline const ChessBoardHistory* getHistory(const ChessBoard *restrict board) {
+    return &board->history[board->historyPly];
+}
 
 static inline Key getPositionKey(const ChessBoard *restrict board) {
-    return board->history->positionKey;
+    return getHistory(board)->positionKey;
 }
 
 static inline Square getEnPassant(const ChessBoard *restrict board) {
-    return board->history->enPassant;
+    return getHistory(board)->enPassant;
 }
 
 static inline Bitboard getCheckers(const ChessBoard *restrict board) {
-    return board->history->checkers;
+    return getHistory(board)->checkers;
 }
 
 static inline Bitboard getPieces(const ChessBoard *restrict board, Colour c, PieceType pt) {
@@ -73,33 +106,62 @@ static inline bool insufficientMaterial(const ChessBoard *restrict board) {
 }
 
 // TODO: For search, but repetition by history vs repetition by search tree transpose
-// Checks for twofold repetition
+// Checks for twofold repetition. Positions before the FEN the game started from are unknown, so the walk also ends there
 static inline bool isRepetition(const ChessBoard *restrict board) {
-    if (board->history->halfmoveClock >= 4) {
-        Key current = getPositionKey(board);
-        ChessBoardHistory *previous = board->history->previous->previous->previous->previous;
-        if (current == previous->positionKey) return true;
-        for (int count = previous->halfmoveClock; count >= 2; count -= 2) {
-            previous = previous->previous->previous;
-            if (current == previous->positionKey) return true;
-        }
+    const ChessBoardHistory *current = getHistory(board);
+    int end = min(current->halfmoveClock, board->historyPly);
+    for (int distance = 4; distance <= end; distance += 2)
+        if (current[-distance].positionKey == current->positionKey) return true;
+    return false;
+}
+
+// https://www.chessprogramming.org/Repetitions#Cuckoo_Tables
+// Checks whether the side to move has a reversible move that reaches an earlier position, so it can at least force a draw.
+// The keys of the positions in between must cancel out so that only the pieces of the side to move differ.
+// Positions before the root were a repetition only if the move is made by the side to move
+static inline bool hasUpcomingRepetition(const ChessBoard *restrict board, int ply) {
+    const ChessBoardHistory *current = getHistory(board);
+    int end = min(current->halfmoveClock, board->historyPly);
+    if (end < 3) return false;
+
+    Key other = current->positionKey ^ current[-1].positionKey ^ zobristHashes.sideToMove;
+    for (int distance = 3; distance <= end; distance += 2) {
+        other ^= current[-distance + 1].positionKey ^ current[-distance].positionKey ^ zobristHashes.sideToMove;
+        if (other) continue;
+
+        Key moveKey = current->positionKey ^ current[-distance].positionKey;
+        int i = cuckooHash1(moveKey);
+        if (cuckooKeys[i] != moveKey && cuckooKeys[i = cuckooHash2(moveKey)] != moveKey) continue;
+
+        Square fromSquare = getFromSquare(cuckooMoves[i]);
+        Square toSquare = getToSquare(cuckooMoves[i]);
+        Bitboard endpoints = squareToBitboard(fromSquare) | squareToBitboard(toSquare);
+        if (inBetweenLine[fromSquare][toSquare] & ~endpoints & getOccupiedSquares(board)) continue;
+        if (ply > distance || endpoints & board->pieces[board->sideToMove][ALL_PIECES]) return true;
     }
     return false;
 }
 
 static inline void undoNullMove(ChessBoard *restrict board) {
     board->sideToMove ^= 1;
-    board->history = board->history->previous;
+    board->historyPly--;
 }
 
-void initializeChessBoard();
-
-void parseFEN(ChessBoard *restrict board, ChessBoardHistory *restrict history, Accumulator *restrict accumulator, const char *restrict fen);
+// The accumulator is refreshed from the board unless it is nullptr
+void parseFEN(ChessBoard *restrict board, Accumulator *restrict accumulator, const char *restrict fen);
+void refreshAccumulator(const ChessBoard *restrict board, Accumulator *restrict accumulator);
 void getFEN(const ChessBoard *restrict board, char *restrict destination);
 
-void makeNullMove(ChessBoard *restrict board, ChessBoardHistory *restrict newState);
-void makeMove(ChessBoard *restrict board, ChessBoardHistory *restrict newState, Accumulator *restrict accumulator, Move move);
+void makeNullMove(ChessBoard *restrict board);
+// If tt is not nullptr, the bucket of the new position is prefetched.
+// Only the dirty pieces are recorded in the accumulator, it must be the next accumulator in the stack
+void makeMove(ChessBoard *restrict board, Accumulator *restrict accumulator, const TT *restrict tt, Move move);
+// Only updates the board, for walks that never evaluate such as perft and replaying moves
+void makeBoardMove(ChessBoard *restrict board, Move move);
 void undoMove(ChessBoard *restrict board, Move move);
+// Positions before the last irreversible move can never repeat, so they are dropped after each game move
+// and a long game cannot overflow the history stack. Not for use in search, undoMove cannot restore them
+void discardIrreversibleHistory(ChessBoard *restrict board);
 bool isDraw(const ChessBoard *restrict board);
 bool isLegalMove(const ChessBoard *restrict board, Move move);
 bool isPseudoMove(const ChessBoard *restrict board, Move move);
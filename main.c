@@ -1,10 +1,13 @@
-#include "attacks.h"
+#include <string.h>
+#include "bench.h"
 #include "chess_board.h"
+#include "nnue.h"
 #include "uci.h"
 
-int main () {
-    initializeAttacks();
-    initializeChessBoard();
-    uciLoop();
+int main (int argc, char *argv[]) {
+    initializeNNUE();
+    // ./Revolver bench [depth] runs the search benchmark without entering the UCI loop
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) bench(parseBenchDepth(argc > 2 ? argv[2] : nullptr));
+    else uciLoop();
     return 0;
 }
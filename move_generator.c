@@ -114,7 +114,7 @@ MoveObject* createMoveList(const ChessBoard *restrict board, MoveObject *restric
 MoveObject* generateCastleMoves(const ChessBoard *restrict board, MoveObject *restrict moveList) {
     Colour stm = board->sideToMove;
     CastlingRights stmRights = stm ? BLACK_RIGHTS : WHITE_RIGHTS;
-    stmRights &= board->history->castlingRights;
+    stmRights &= getHistory(board)->castlingRights;
     if (stmRights) { 
         const Square knightSquare[CASTLING_SIDES][COLOURS] = {{G1, G8}, {B1, B8}};
         const Square castlePathStartSquare[CASTLING_SIDES][COLOURS] = {{F1, F8}, {D1, D8}};
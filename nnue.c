@@ -1,100 +1,198 @@
-#include <immintrin.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <stdlib.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include "nnue.h"
+#include "nnue_kernels.h"
 #include "utility.h"
 
-constexpr int FLIP_MASK       = 0b111000;
 constexpr int SCORE_SCALE     =      400;
-constexpr int QUANTIZATION_A  =      255;
 constexpr int QUANTIZATION_B  =       64;
 constexpr int PERSPECTIVE     =        2;
 
 typedef struct Network {
-    int16_t accumulatorWeights[COLOURS][PIECE_TYPES - 1][SQUARES][LAYER1];
+    int16_t accumulatorWeights[KING_BUCKETS][COLOURS][PIECE_TYPES - 1][SQUARES][LAYER1];
     int16_t accumulatorBiases[LAYER1];
 
     int16_t outputWeights[LAYER1 * PERSPECTIVE];
     int16_t outputBias;
 } Network;
 
-static const uint8_t networkData[] = {
+// Networks are stored padded to a multiple of 64 bytes
+constexpr size_t NETWORK_FILE_SIZE = (sizeof(Network) + 63) / 64 * 64;
+
+alignas(64) static const uint8_t networkData[] = {
     #embed "nnue.bin"
 };
 
+static_assert(sizeof(networkData) == NETWORK_FILE_SIZE, "nnue.bin does not match the network architecture");
+
 static const Network *network = (const Network *) networkData;
+static void *loadedNetwork; // Mapping of the network loaded from EvalFile, nullptr when the embedded network is used
+
+// FNV-1a, identifies which network is loaded
+static uint64_t hashNetwork(const uint8_t *data, size_t size) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < size; i++) hash = (hash ^ data[i]) * 0x100000001B3ULL;
+    return hash;
+}
+
+static void unloadNetwork() {
+    if (!loadedNetwork) return;
+#ifdef _WIN32
+    alignedFree(loadedNetwork);
+#else
+    munmap(loadedNetwork, NETWORK_FILE_SIZE);
+#endif
+    loadedNetwork = nullptr;
+}
 
-void accumulatorReset(Accumulator *restrict accumulator) {
-    for (int i = 0; i < LAYER1; i++) {
-        accumulator->accumulator[WHITE][i] = network->accumulatorBiases[i];
-        accumulator->accumulator[BLACK][i] = network->accumulatorBiases[i];
+// Mapped pages are aligned, so the network can be used in place
+static void* mapNetwork(const char *restrict path) {
+#ifdef _WIN32
+    FILE *file = fopen(path, "rb");
+    if (!file) return nullptr;
+    void *data = alignedAllocate(64, NETWORK_FILE_SIZE);
+    bool valid = data && fread(data, 1, NETWORK_FILE_SIZE, file) == NETWORK_FILE_SIZE && fgetc(file) == EOF;
+    fclose(file);
+    if (!valid) alignedFree(data);
+    return valid ? data : nullptr;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return nullptr;
+    struct stat st;
+    void *data = fstat(fd, &st) == 0 && (size_t) st.st_size == NETWORK_FILE_SIZE ? mmap(nullptr, NETWORK_FILE_SIZE, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    return data == MAP_FAILED ? nullptr : data;
+#endif
+}
+
+bool loadNetwork(const char *restrict path) {
+    if (!path || strcmp(path, DEFAULT_NETWORK) == 0) {
+        unloadNetwork();
+        network = (const Network *) networkData;
+        printf("info string using embedded network, hash %016llx\n", hashNetwork(networkData, NETWORK_FILE_SIZE));
+        return true;
+    }
+
+    void *data = mapNetwork(path);
+    if (!data) {
+        printf("info string failed to load network %s, expected a file of %zu bytes\n", path, NETWORK_FILE_SIZE);
+        return false;
     }
+    unloadNetwork();
+    loadedNetwork = data;
+    network = loadedNetwork;
+    printf("info string loaded network %s, hash %016llx\n", path, hashNetwork(data, NETWORK_FILE_SIZE));
+    return true;
 }
 
-void accumulatorAdd(Accumulator *restrict accumulator, Colour c, PieceType pt, Square sq) {
-    pt--;
-    for (int i = 0; i < LAYER1; i++) accumulator->accumulator[WHITE][i] += network->accumulatorWeights[c    ][pt][sq ^ FLIP_MASK][i];
-    for (int i = 0; i < LAYER1; i++) accumulator->accumulator[BLACK][i] += network->accumulatorWeights[c ^ 1][pt][sq            ][i];
+static const NNUEKernels *kernels;
+
+// Feature weights of a piece as seen from the given perspective, black sees the board flipped
+static inline const int16_t* getFeatureWeights(Colour perspective, int bucket, Colour c, PieceType pt, Square sq) {
+    return perspective == WHITE ? network->accumulatorWeights[bucket][c    ][pt - 1][sq ^ FLIP_MASK]
+                                : network->accumulatorWeights[bucket][c ^ 1][pt - 1][sq            ];
 }
 
-void accumulatorSub(Accumulator *restrict accumulator, Colour c, PieceType pt, Square sq) {
-    pt--;
-    for (int i = 0; i < LAYER1; i++) accumulator->accumulator[WHITE][i] -= network->accumulatorWeights[c    ][pt][sq ^ FLIP_MASK][i];
-    for (int i = 0; i < LAYER1; i++) accumulator->accumulator[BLACK][i] -= network->accumulatorWeights[c ^ 1][pt][sq            ][i];
+static inline int getBucketOfPieces(Colour perspective, const Bitboard pieces[COLOURS][PIECE_TYPES]) {
+    return getKingBucket(perspective, bitboardToSquare(pieces[perspective][KING]));
 }
 
-void accumulatorAddSub(Accumulator *restrict accumulator, Colour c, PieceType pt, Square fromSquare, Square toSquare) {
-    pt--;
-    for (int i = 0; i < LAYER1; i++)
-        accumulator->accumulator[WHITE][i] += network->accumulatorWeights[c][pt][toSquare ^ FLIP_MASK][i] - network->accumulatorWeights[c][pt][fromSquare ^ FLIP_MASK][i];
+static void refreshPerspective(Accumulator *restrict accumulator, const Bitboard pieces[COLOURS][PIECE_TYPES], Colour perspective) {
+    int bucket = getBucketOfPieces(perspective, pieces);
+    int16_t *output = accumulator->accumulator[perspective];
+    memcpy(output, network->accumulatorBiases, sizeof(accumulator->accumulator[perspective]));
+    for (Colour c = WHITE; c < COLOURS; c++)
+        for (PieceType pt = PAWN; pt < PIECE_TYPES; pt++)
+            for (Bitboard b = pieces[c][pt]; b;)
+                kernels->addFeature(output, getFeatureWeights(perspective, bucket, c, pt, bitboardToSquareWithReset(&b)));
+    accumulator->computed[perspective] = true;
+}
 
-    for (int i = 0; i < LAYER1; i++)
-        accumulator->accumulator[BLACK][i] += network->accumulatorWeights[c ^ 1][pt][toSquare][i] - network->accumulatorWeights[c ^ 1][pt][fromSquare][i];
+// Only the pieces that differ from the last refresh in the same king bucket are applied
+static void refreshPerspectiveFromCache(Accumulator *restrict accumulator, RefreshCache *restrict cache, const Bitboard pieces[COLOURS][PIECE_TYPES], Colour perspective) {
+    int bucket = getBucketOfPieces(perspective, pieces);
+    RefreshEntry *entry = &cache->entries[perspective][bucket];
+    int16_t *cached = entry->accumulator;
+    for (Colour c = WHITE; c < COLOURS; c++)
+        for (PieceType pt = PAWN; pt < PIECE_TYPES; pt++) {
+            Bitboard added   = pieces[c][pt] & ~entry->pieces[c][pt];
+            Bitboard removed = entry->pieces[c][pt] & ~pieces[c][pt];
+            while (added  ) kernels->addFeature(cached, getFeatureWeights(perspective, bucket, c, pt, bitboardToSquareWithReset(&added  )));
+            while (removed) kernels->subFeature(cached, getFeatureWeights(perspective, bucket, c, pt, bitboardToSquareWithReset(&removed)));
+            entry->pieces[c][pt] = pieces[c][pt];
+        }
+    memcpy(accumulator->accumulator[perspective], entry->accumulator, sizeof(entry->accumulator));
+    accumulator->computed[perspective] = true;
 }
 
-void accumulatorAddSubPromotion(Accumulator *restrict accumulator, Colour c, PieceType pt, Square fromSquare, Square toSquare) {
-    pt--;
-    for (int i = 0; i < LAYER1; i++)
-        accumulator->accumulator[WHITE][i] += network->accumulatorWeights[c][pt][toSquare ^ FLIP_MASK][i] - network->accumulatorWeights[c][PAWN - 1][fromSquare ^ FLIP_MASK][i];
+// A move adds and removes at most two features: a quiet move or promotion is one of each, a capture removes
+// one more and castling moves two pieces. A null move has no dirty pieces and is copied
+static void updatePerspective(Accumulator *restrict output, const Accumulator *restrict input, Colour perspective, int bucket) {
+    const int16_t *adds[2], *subs[2];
+    int numberOfAdds = 0, numberOfSubs = 0;
+    for (int i = 0; i < output->numberOfDirtyPieces; i++) {
+        const DirtyPiece *dp = &output->dirtyPieces[i];
+        if (dp->toSquare   != NO_SQUARE) adds[numberOfAdds++] = getFeatureWeights(perspective, bucket, dp->colour, dp->pieceType, dp->toSquare  );
+        if (dp->fromSquare != NO_SQUARE) subs[numberOfSubs++] = getFeatureWeights(perspective, bucket, dp->colour, dp->pieceType, dp->fromSquare);
+    }
 
-    for (int i = 0; i < LAYER1; i++)
-        accumulator->accumulator[BLACK][i] += network->accumulatorWeights[c ^ 1][pt][toSquare][i] - network->accumulatorWeights[c ^ 1][PAWN - 1][fromSquare][i];
+    int16_t *outputValues = output->accumulator[perspective];
+    const int16_t *inputValues = input->accumulator[perspective];
+    if      (numberOfSubs == 1) kernels->addSub(outputValues, inputValues, adds[0], subs[0]);
+    else if (numberOfAdds == 1) kernels->addSubSub(outputValues, inputValues, adds[0], subs[0], subs[1]);
+    else if (numberOfAdds == 2) kernels->addAddSubSub(outputValues, inputValues, adds[0], adds[1], subs[0], subs[1]);
+    else memcpy(outputValues, inputValues, sizeof(output->accumulator[perspective]));
+    output->computed[perspective] = true;
 }
 
-// TODO: Make the accumulator aligned
-// TODO: Should I have two separate sums, then combine into one sum?
-// TODO: Find better intrinsics to use instead of storeu for sumArr
-Score evaluation(const Accumulator *restrict accumulator, Colour stm) {
-    constexpr int NUMBER_OF_VECTORS = LAYER1 / 16;
-    const __m256i zeroVector    = _mm256_setzero_si256();
-    const __m256i qaVector      = _mm256_set1_epi16(QUANTIZATION_A);
-    const __m256i *stmAcc       = (const __m256i *) accumulator->accumulator[stm    ];
-    const __m256i *enemyAcc     = (const __m256i *) accumulator->accumulator[stm ^ 1];
-    const __m256i *stmWeights   = (const __m256i *) network->outputWeights;
-    const __m256i *enemyWeights = stmWeights + NUMBER_OF_VECTORS;
-
-    __m256i sum = zeroVector;
-    for (int i = 0; i < NUMBER_OF_VECTORS; i++) {
-        __m256i stmAccVector      = _mm256_loadu_si256(&stmAcc[i]);
-        __m256i enemyAccVector    = _mm256_loadu_si256(&enemyAcc[i]);
-        __m256i stmWeightVector   = _mm256_load_si256(&stmWeights[i]);
-        __m256i enemyWeightVector = _mm256_load_si256(&enemyWeights[i]);
-
-        __m256i stmClamped   = _mm256_min_epi16(_mm256_max_epi16(stmAccVector  , zeroVector), qaVector);
-        __m256i enemyClamped = _mm256_min_epi16(_mm256_max_epi16(enemyAccVector, zeroVector), qaVector);
-
-        __m256i stmResult   = _mm256_madd_epi16(_mm256_mullo_epi16(stmClamped  , stmWeightVector  ), stmClamped  );
-        __m256i enemyResult = _mm256_madd_epi16(_mm256_mullo_epi16(enemyClamped, enemyWeightVector), enemyClamped);
-
-        sum = _mm256_add_epi32(sum, stmResult  );
-        sum = _mm256_add_epi32(sum, enemyResult);
+void accumulatorRefresh(Accumulator *restrict accumulator, const Bitboard pieces[COLOURS][PIECE_TYPES]) {
+    accumulator->numberOfDirtyPieces = 0;
+    accumulator->needsRefresh[WHITE] = accumulator->needsRefresh[BLACK] = false;
+    refreshPerspective(accumulator, pieces, WHITE);
+    refreshPerspective(accumulator, pieces, BLACK);
+}
+
+// Every entry starts as an empty board, the first refresh in a bucket adds all of the pieces
+void resetRefreshCache(RefreshCache *restrict cache) {
+    for (Colour perspective = WHITE; perspective < COLOURS; perspective++)
+        for (int bucket = 0; bucket < KING_BUCKETS; bucket++) {
+            RefreshEntry *entry = &cache->entries[perspective][bucket];
+            memcpy(entry->accumulator, network->accumulatorBiases, sizeof(entry->accumulator));
+            memset(entry->pieces, 0, sizeof(entry->pieces));
+        }
+}
+
+void updateAccumulator(Accumulator *accumulator, RefreshCache *restrict cache, const Bitboard pieces[COLOURS][PIECE_TYPES]) {
+    for (Colour perspective = WHITE; perspective < COLOURS; perspective++) {
+        Accumulator *computed = accumulator;
+        while (!computed->computed[perspective] && !computed->needsRefresh[perspective]) computed--;
+
+        // The king bucket is the same for every accumulator after the last refresh
+        if (!computed->computed[perspective]) refreshPerspectiveFromCache(accumulator, cache, pieces, perspective);
+        else for (int bucket = getBucketOfPieces(perspective, pieces); computed < accumulator; computed++)
+            updatePerspective(computed + 1, computed, perspective, bucket);
     }
+}
 
-    int32_t sumArr[8];
-    _mm256_storeu_si256((__m256i *) sumArr, sum);
+void initializeNNUE() {
+    kernels = selectNNUEKernels();
+}
 
-    Score score = 0;
-    for (int i = 0; i < 8; i++) score += sumArr[i];
+const char* getNNUEKernelsName() {
+    return kernels->name;
+}
 
+Score evaluation(const Accumulator *restrict accumulator, Colour stm) {
+    Score score = kernels->outputLayer(accumulator->accumulator[stm], accumulator->accumulator[stm ^ 1], network->outputWeights);
     score /= QUANTIZATION_A;
     score += network->outputBias;
     return score * SCORE_SCALE / (QUANTIZATION_A * QUANTIZATION_B);
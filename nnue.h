@@ -5,21 +5,82 @@
 #include "utility.h"
 
 constexpr int LAYER1 = 128;
+constexpr char DEFAULT_NETWORK[] = "<embedded>";
+constexpr int FLIP_MASK = 0b111000;
 
+// Inputs are bucketed by the square of the perspective's king. The shipped network has a single bucket,
+// a bucketed network only needs a new layout with KING_BUCKETS updated to match
+constexpr int KING_BUCKETS = 1;
+constexpr uint8_t KING_BUCKET_LAYOUT[SQUARES] = {0}; // Indexed by the square relative to the perspective
+
+constexpr int MAX_DIRTY_PIECES = 3; // A capture with promotion removes two pieces and adds one
+
+// A piece that changed in the move leading to the accumulator's position.
+// A fromSquare of NO_SQUARE is an added piece, a toSquare of NO_SQUARE is a removed piece
+typedef struct DirtyPiece {
+    uint8_t colour;
+    uint8_t pieceType;
+    uint8_t fromSquare;
+    uint8_t toSquare;
+} DirtyPiece;
+
+// Accumulators are updated lazily: makeMove only records the dirty pieces, and the accumulator is
+// computed from the nearest computed accumulator before it when the position is evaluated.
+// Accumulators are therefore kept in a stack indexed by ply, where the root is always computed
+// A king moving to another bucket makes its perspective need a refresh instead of an update
 typedef struct Accumulator {
-    int16_t accumulator[COLOURS][LAYER1];
+    alignas(64) int16_t accumulator[COLOURS][LAYER1];
+    DirtyPiece dirtyPieces[MAX_DIRTY_PIECES];
+    uint8_t numberOfDirtyPieces;
+    bool computed[COLOURS];
+    bool needsRefresh[COLOURS];
 } Accumulator;
 
-void accumulatorReset(Accumulator *restrict accumulator);
-// Adds a piece to the accumulator, always using the perspective of white.
-void accumulatorAdd(Accumulator *restrict accumulator, Colour c, PieceType pt, Square sq);
-// Removes a piece from the accumulator, always using the perspective of white.
-void accumulatorSub(Accumulator *restrict accumulator, Colour c, PieceType pt, Square sq);
-// Adds a piece to the accumulator, and removes it from the square it was previously on.
-// Always using the perspective of white.
-void accumulatorAddSub(Accumulator *restrict accumulator, Colour c, PieceType pt, Square fromSquare, Square toSquare);
-void accumulatorAddSubPromotion(Accumulator *restrict accumulator, Colour c, PieceType pt, Square fromSquare, Square toSquare);
+// The accumulator and pieces of the last refresh of a perspective in a king bucket, so that
+// a refresh only applies the difference to the pieces on the board. One per search thread
+typedef struct RefreshEntry {
+    alignas(64) int16_t accumulator[LAYER1];
+    Bitboard pieces[COLOURS][PIECE_TYPES];
+} RefreshEntry;
+
+typedef struct RefreshCache {
+    RefreshEntry entries[COLOURS][KING_BUCKETS];
+} RefreshCache;
+
+static inline int getKingBucket(Colour perspective, Square kingSquare) {
+    return KING_BUCKET_LAYOUT[perspective == WHITE ? kingSquare ^ FLIP_MASK : kingSquare];
+}
+
+static inline void resetDirtyPieces(Accumulator *accumulator) {
+    accumulator->numberOfDirtyPieces = 0;
+    accumulator->computed[WHITE] = accumulator->computed[BLACK] = false;
+    accumulator->needsRefresh[WHITE] = accumulator->needsRefresh[BLACK] = false;
+}
+
+static inline void addDirtyPiece(Accumulator *accumulator, Colour c, PieceType pt, Square fromSquare, Square toSquare) {
+    accumulator->dirtyPieces[accumulator->numberOfDirtyPieces++] = (DirtyPiece) {c, pt, fromSquare, toSquare};
+}
+
+static inline void markKingMove(Accumulator *accumulator, Colour c, Square fromSquare, Square toSquare) {
+    if (getKingBucket(c, fromSquare) != getKingBucket(c, toSquare)) accumulator->needsRefresh[c] = true;
+}
+
+// Selects the evaluation kernels for the instruction sets of the CPU, must be called before any evaluation
+void initializeNNUE();
+const char* getNNUEKernelsName();
+
+// Computes the accumulator from scratch
+void accumulatorRefresh(Accumulator *restrict accumulator, const Bitboard pieces[COLOURS][PIECE_TYPES]);
+void resetRefreshCache(RefreshCache *restrict cache);
+// Computes the accumulator by applying the dirty pieces of every uncomputed accumulator below it in the stack.
+// A perspective whose king changed bucket on the way is refreshed from the cache with the given pieces instead
+void updateAccumulator(Accumulator *accumulator, RefreshCache *restrict cache, const Bitboard pieces[COLOURS][PIECE_TYPES]);
+
+// Loads a network file of the same architecture, DEFAULT_NETWORK or nullptr restores the embedded network.
+// The current network is kept if the file cannot be loaded. Accumulators must be refreshed after a load
+bool loadNetwork(const char *restrict path);
 
+// The accumulator must be up to date
 Score evaluation(const Accumulator *restrict accumulator, Colour stm);
 
 #endif
@@ -0,0 +1,210 @@
+#include <immintrin.h>
+#include <stdint.h>
+#include "nnue_kernels.h"
+
+// Each kernel is compiled for its own instruction set through the target attribute, so a binary built for
+// a baseline architecture can still use the widest vectors of the CPU it runs on.
+// All kernels produce identical results, the output layer multiplies in 16 bits like _mm_mullo_epi16
+
+/* Scalar */
+static void addFeatureScalar(int16_t *restrict accumulator, const int16_t *restrict weights) {
+    for (int i = 0; i < LAYER1; i++) accumulator[i] += weights[i];
+}
+
+static void subFeatureScalar(int16_t *restrict accumulator, const int16_t *restrict weights) {
+    for (int i = 0; i < LAYER1; i++) accumulator[i] -= weights[i];
+}
+
+static void addSubScalar(int16_t *restrict output, const int16_t *restrict input, const int16_t *restrict add, const int16_t *restrict sub) {
+    for (int i = 0; i < LAYER1; i++) output[i] = input[i] + add[i] - sub[i];
+}
+
+static void addSubSubScalar(int16_t *restrict output, const int16_t *restrict input, const int16_t *restrict add, const int16_t *restrict sub1, const int16_t *restrict sub2) {
+    for (int i = 0; i < LAYER1; i++) output[i] = input[i] + add[i] - sub1[i] - sub2[i];
+}
+
+static void addAddSubSubScalar(int16_t *restrict output, const int16_t *restrict input, const int16_t *restrict add1, const int16_t *restrict add2, const int16_t *restrict sub1, const int16_t *restrict sub2) {
+    for (int i = 0; i < LAYER1; i++) output[i] = input[i] + add1[i] + add2[i] - sub1[i] - sub2[i];
+}
+
+static int32_t outputLayerScalar(const int16_t *restrict stmAccumulator, const int16_t *restrict enemyAccumulator, const int16_t *restrict weights) {
+    int32_t sum = 0;
+    for (int i = 0; i < LAYER1; i++) {
+        int32_t stm   = max(0, min(stmAccumulator  [i], QUANTIZATION_A));
+        int32_t enemy = max(0, min(enemyAccumulator[i], QUANTIZATION_A));
+        sum += (int16_t) (stm   * weights[i         ]) * stm;
+        sum += (int16_t) (enemy * weights[i + LAYER1]) * enemy;
+    }
+    return sum;
+}
+
+/* SSE4.1 */
+[[gnu::target("sse4.1")]] static inline int32_t horizontalSum128(__m128i sum) {
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+
+[[gnu::target("sse4.1")]] static void addFeatureSse41(int16_t *restrict accumulator, const int16_t *restrict weights) {
+    __m128i *acc = (__m128i *) accumulator;
+    const __m128i *w = (const __m128i *) weights;
+    for (int i = 0; i < LAYER1 / 8; i++) acc[i] = _mm_add_epi16(acc[i], w[i]);
+}
+
+[[gnu::target("sse4.1")]] static void subFeatureSse41(int16_t *restrict accumulator, const int16_t *restrict weights) {
+    __m128i *acc = (__m128i *) accumulator;
+    const __m128i *w = (const __m128i *) weights;
+    for (int i = 0; i < LAYER1 / 8; i++) acc[i] = _mm_sub_epi16(acc[i], w[i]);
+}
+
+[[gnu::target("sse4.1")]] static void addSubSse41(int16_t *restrict output, const int16_t *restrict input, const int16_t *restrict add, const int16_t *restrict sub) {
+    __m128i *out = (__m128i *) output;
+    const __m128i *in = (const __m128i *) input, *a = (const __m128i *) add, *s = (const __m128i *) sub;
+    for (int i = 0; i < LAYER1 / 8; i++) out[i] = _mm_sub_epi16(_mm_add_epi16(in[i], a[i]), s[i]);
+}
+
+[[gnu::target("sse4.1")]] static void addSubSubSse41(int16_t *restrict output, const int16_t *restrict input, const int16_t *restrict add, const int16_t *restrict sub1, const int16_t *restrict sub2) {
+    __m128i *out = (__m128i *) output;
+    const __m128i *in = (const __m128i *) input, *a = (const __m128i *) add, *s1 = (const __m128i *) sub1, *s2 = (const __m128i *) sub2;
+    for (int i = 0; i < LAYER1 / 8; i++) out[i] = _mm_sub_epi16(_mm_sub_epi16(_mm_add_epi16(in[i], a[i]), s1[i]), s2[i]);
+}
+
+[[gnu::target("sse4.1")]] static void addAddSubSubSse41(int16_t *restrict output, const int16_t *restrict input, const int16_t *restrict add1, const int16_t *restrict add2, const int16_t *restrict sub1, const int16_t *restrict sub2) {
+    __m128i *out = (__m128i *) output;
+    const __m128i *in = (const __m128i *) input, *a1 = (const __m128i *) add1, *a2 = (const __m128i *) add2, *s1 = (const __m128i *) sub1, *s2 = (const __m128i *) sub2;
+    for (int i = 0; i < LAYER1 / 8; i++) out[i] = _mm_sub_epi16(_mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(in[i], a1[i]), a2[i]), s1[i]), s2[i]);
+}
+
+[[gnu::target("sse4.1")]] static int32_t outputLayerSse41(const int16_t *restrict stmAccumulator, const int16_t *restrict enemyAccumulator, const int16_t *restrict weights) {
+    const __m128i zero = _mm_setzero_si128(), qa = _mm_set1_epi16(QUANTIZATION_A);
+    const __m128i *stmAcc = (const __m128i *) stmAccumulator, *enemyAcc = (const __m128i *) enemyAccumulator;
+    const __m128i *stmWeights = (const __m128i *) weights, *enemyWeights = stmWeights + LAYER1 / 8;
+    __m128i sum = zero;
+    for (int i = 0; i < LAYER1 / 8; i++) {
+        __m128i stm   = _mm_min_epi16(_mm_max_epi16(stmAcc  [i], zero), qa);
+        __m128i enemy = _mm_min_epi16(_mm_max_epi16(enemyAcc[i], zero), qa);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_mullo_epi16(stm  , stmWeights  [i]), stm  ));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_mullo_epi16(enemy, enemyWeights[i]), enemy));
+    }
+    return horizontalSum128(sum);
+}
+
+/* AVX2 */
+[[gnu::target("avx2")]] static void addFeatureAvx2(int16_t *restrict accumulator, const int16_t *restrict weights) {
+    __m256i *acc = (__m256i *) accumulator;
+    const __m256i *w = (const __m256i *) weights;
+    for (int i = 0; i < LAYER1 / 16; i++) acc[i] = _mm256_add_epi16(acc[i], w[i]);
+}
+
+[[gnu::target("avx2")]] static void subFeatureAvx2(int16_t *restrict accumulator, const int16_t *restrict weights) {
+    __m256i *acc = (__m256i *) accumulator;
+    const __m256i *w = (const __m256i *) weights;
+    for (int i = 0; i < LAYER1 / 16; i++) acc[i] = _mm256_sub_epi16(acc[i], w[i]);
+}
+
+[[gnu::target("avx2")]] static void addSubAvx2(int16_t *restrict output, const int16_t *restrict input, const int16_t *restrict add, const int16_t *restrict sub) {
+    __m256i *out = (__m256i *) output;
+    const __m256i *in = (const __m256i *) input, *a = (const __m256i *) add, *s = (const __m256i *) sub;
+    for (int i = 0; i < LAYER1 / 16; i++) out[i] = _mm256_sub_epi16(_mm256_add_epi16(in[i], a[i]), s[i]);
+}
+
+[[gnu::target("avx2")]] static void addSubSubAvx2(int16_t *restrict output, const int16_t *restrict input, const int16_t *restrict add, const int16_t *restrict sub1, const int16_t *restrict sub2) {
+    __m256i *out = (__m256i *) output;
+    const __m256i *in = (const __m256i *) input, *a = (const __m256i *) add, *s1 = (const __m256i *) sub1, *s2 = (const __m256i *) sub2;
+    for (int i = 0; i < LAYER1 / 16; i++) out[i] = _mm256_sub_epi16(_mm256_sub_epi16(_mm256_add_epi16(in[i], a[i]), s1[i]), s2[i]);
+}
+
+[[gnu::target("avx2")]] static void addAddSubSubAvx2(int16_t *restrict output, const int16_t *restrict input, const int16_t *restrict add1, const int16_t *restrict add2, const int16_t *restrict sub1, const int16_t *restrict sub2) {
+    __m256i *out = (__m256i *) output;
+    const __m256i *in = (const __m256i *) input, *a1 = (const __m256i *) add1, *a2 = (const __m256i *) add2, *s1 = (const __m256i *) sub1, *s2 = (const __m256i *) sub2;
+    for (int i = 0; i < LAYER1 / 16; i++) out[i] = _mm256_sub_epi16(_mm256_sub_epi16(_mm256_add_epi16(_mm256_add_epi16(in[i], a1[i]), a2[i]), s1[i]), s2[i]);
+}
+
+[[gnu::target("avx2")]] static int32_t outputLayerAvx2(const int16_t *restrict stmAccumulator, const int16_t *restrict enemyAccumulator, const int16_t *restrict weights) {
+    const __m256i zero = _mm256_setzero_si256(), qa = _mm256_set1_epi16(QUANTIZATION_A);
+    const __m256i *stmAcc = (const __m256i *) stmAccumulator, *enemyAcc = (const __m256i *) enemyAccumulator;
+    const __m256i *stmWeights = (const __m256i *) weights, *enemyWeights = stmWeights + LAYER1 / 16;
+    __m256i sum = zero;
+    for (int i = 0; i < LAYER1 / 16; i++) {
+        __m256i stm   = _mm256_min_epi16(_mm256_max_epi16(stmAcc  [i], zero), qa);
+        __m256i enemy = _mm256_min_epi16(_mm256_max_epi16(enemyAcc[i], zero), qa);
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_mullo_epi16(stm  , stmWeights  [i]), stm  ));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_mullo_epi16(enemy, enemyWeights[i]), enemy));
+    }
+    return horizontalSum128(_mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1)));
+}
+
+/* AVX-512 */
+[[gnu::target("avx512f,avx512bw")]] static void addFeatureAvx512(int16_t *restrict accumulator, const int16_t *restrict weights) {
+    __m512i *acc = (__m512i *) accumulator;
+    const __m512i *w = (const __m512i *) weights;
+    for (int i = 0; i < LAYER1 / 32; i++) acc[i] = _mm512_add_epi16(acc[i], w[i]);
+}
+
+[[gnu::target("avx512f,avx512bw")]] static void subFeatureAvx512(int16_t *restrict accumulator, const int16_t *restrict weights) {
+    __m512i *acc = (__m512i *) accumulator;
+    const __m512i *w = (const __m512i *) weights;
+    for (int i = 0; i < LAYER1 / 32; i++) acc[i] = _mm512_sub_epi16(acc[i], w[i]);
+}
+
+[[gnu::target("avx512f,avx512bw")]] static void addSubAvx512(int16_t *restrict output, const int16_t *restrict input, const int16_t *restrict add, const int16_t *restrict sub) {
+    __m512i *out = (__m512i *) output;
+    const __m512i *in = (const __m512i *) input, *a = (const __m512i *) add, *s = (const __m512i *) sub;
+    for (int i = 0; i < LAYER1 / 32; i++) out[i] = _mm512_sub_epi16(_mm512_add_epi16(in[i], a[i]), s[i]);
+}
+
+[[gnu::target("avx512f,avx512bw")]] static void addSubSubAvx512(int16_t *restrict output, const int16_t *restrict input, const int16_t *restrict add, const int16_t *restrict sub1, const int16_t *restrict sub2) {
+    __m512i *out = (__m512i *) output;
+    const __m512i *in = (const __m512i *) input, *a = (const __m512i *) add, *s1 = (const __m512i *) sub1, *s2 = (const __m512i *) sub2;
+    for (int i = 0; i < LAYER1 / 32; i++) out[i] = _mm512_sub_epi16(_mm512_sub_epi16(_mm512_add_epi16(in[i], a[i]), s1[i]), s2[i]);
+}
+
+[[gnu::target("avx512f,avx512bw")]] static void addAddSubSubAvx512(int16_t *restrict output, const int16_t *restrict input, const int16_t *restrict add1, const int16_t *restrict add2, const int16_t *restrict sub1, const int16_t *restrict sub2) {
+    __m512i *out = (__m512i *) output;
+    const __m512i *in = (const __m512i *) input, *a1 = (const __m512i *) add1, *a2 = (const __m512i *) add2, *s1 = (const __m512i *) sub1, *s2 = (const __m512i *) sub2;
+    for (int i = 0; i < LAYER1 / 32; i++) out[i] = _mm512_sub_epi16(_mm512_sub_epi16(_mm512_add_epi16(_mm512_add_epi16(in[i], a1[i]), a2[i]), s1[i]), s2[i]);
+}
+
+[[gnu::target("avx512f,avx512bw")]] static int32_t outputLayerAvx512(const int16_t *restrict stmAccumulator, const int16_t *restrict enemyAccumulator, const int16_t *restrict weights) {
+    const __m512i zero = _mm512_setzero_si512(), qa = _mm512_set1_epi16(QUANTIZATION_A);
+    const __m512i *stmAcc = (const __m512i *) stmAccumulator, *enemyAcc = (const __m512i *) enemyAccumulator;
+    const __m512i *stmWeights = (const __m512i *) weights, *enemyWeights = stmWeights + LAYER1 / 32;
+    __m512i sum = zero;
+    for (int i = 0; i < LAYER1 / 32; i++) {
+        __m512i stm   = _mm512_min_epi16(_mm512_max_epi16(stmAcc  [i], zero), qa);
+        __m512i enemy = _mm512_min_epi16(_mm512_max_epi16(enemyAcc[i], zero), qa);
+        sum = _mm512_add_epi32(sum, _mm512_madd_epi16(_mm512_mullo_epi16(stm  , stmWeights  [i]), stm  ));
+        sum = _mm512_add_epi32(sum, _mm512_madd_epi16(_mm512_mullo_epi16(enemy, enemyWeights[i]), enemy));
+    }
+    return _mm512_reduce_add_epi32(sum);
+}
+
+// VNNI fuses the multiply add and the accumulation into one instruction
+[[gnu::target("avx512f,avx512bw,avx512vnni")]] static int32_t outputLayerAvx512Vnni(const int16_t *restrict stmAccumulator, const int16_t *restrict enemyAccumulator, const int16_t *restrict weights) {
+    const __m512i zero = _mm512_setzero_si512(), qa = _mm512_set1_epi16(QUANTIZATION_A);
+    const __m512i *stmAcc = (const __m512i *) stmAccumulator, *enemyAcc = (const __m512i *) enemyAccumulator;
+    const __m512i *stmWeights = (const __m512i *) weights, *enemyWeights = stmWeights + LAYER1 / 32;
+    __m512i sum = zero;
+    for (int i = 0; i < LAYER1 / 32; i++) {
+        __m512i stm   = _mm512_min_epi16(_mm512_max_epi16(stmAcc  [i], zero), qa);
+        __m512i enemy = _mm512_min_epi16(_mm512_max_epi16(enemyAcc[i], zero), qa);
+        sum = _mm512_dpwssd_epi32(sum, _mm512_mullo_epi16(stm  , stmWeights  [i]), stm  );
+        sum = _mm512_dpwssd_epi32(sum, _mm512_mullo_epi16(enemy, enemyWeights[i]), enemy);
+    }
+    return _mm512_reduce_add_epi32(sum);
+}
+
+static const NNUEKernels KERNELS_AVX512_VNNI = {"avx512vnni", addFeatureAvx512, subFeatureAvx512, addSubAvx512, addSubSubAvx512, addAddSubSubAvx512, outputLayerAvx512Vnni};
+static const NNUEKernels KERNELS_AVX512      = {"avx512"    , addFeatureAvx512, subFeatureAvx512, addSubAvx512, addSubSubAvx512, addAddSubSubAvx512, outputLayerAvx512    };
+static const NNUEKernels KERNELS_AVX2        = {"avx2"      , addFeatureAvx2  , subFeatureAvx2  , addSubAvx2  , addSubSubAvx2  , addAddSubSubAvx2  , outputLayerAvx2      };
+static const NNUEKernels KERNELS_SSE41       = {"sse4.1"    , addFeatureSse41 , subFeatureSse41 , addSubSse41 , addSubSubSse41 , addAddSubSubSse41 , outputLayerSse41     };
+static const NNUEKernels KERNELS_SCALAR      = {"scalar"    , addFeatureScalar, subFeatureScalar, addSubScalar, addSubSubScalar, addAddSubSubScalar, outputLayerScalar    };
+
+const NNUEKernels* selectNNUEKernels() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vnni")) return &KERNELS_AVX512_VNNI;
+    if (__builtin_cpu_supports("avx512bw")) return &KERNELS_AVX512;
+    if (__builtin_cpu_supports("avx2")) return &KERNELS_AVX2;
+    if (__builtin_cpu_supports("sse4.1")) return &KERNELS_SSE41;
+    return &KERNELS_SCALAR;
+}
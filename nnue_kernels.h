@@ -0,0 +1,25 @@
+#ifndef NNUE_KERNELS_H
+#define NNUE_KERNELS_H
+
+#include <stdint.h>
+#include "nnue.h"
+
+constexpr int QUANTIZATION_A = 255; // The accumulator is clamped to [0, QUANTIZATION_A] before the output layer
+
+// The same operations implemented for each instruction set. Accumulators and weights are 64 byte aligned
+typedef struct NNUEKernels {
+    const char *name;
+    void (*addFeature)(int16_t *restrict accumulator, const int16_t *restrict weights);
+    void (*subFeature)(int16_t *restrict accumulator, const int16_t *restrict weights);
+    // The fused kernels read the parent accumulator once and write the child once
+    void (*addSub)(int16_t *restrict output, const int16_t *restrict input, const int16_t *restrict add, const int16_t *restrict sub);
+    void (*addSubSub)(int16_t *restrict output, const int16_t *restrict input, const int16_t *restrict add, const int16_t *restrict sub1, const int16_t *restrict sub2);
+    void (*addAddSubSub)(int16_t *restrict output, const int16_t *restrict input, const int16_t *restrict add1, const int16_t *restrict add2, const int16_t *restrict sub1, const int16_t *restrict sub2);
+    // Sum of the squared clipped activations times the output weights, the weights of the enemy follow those of the side to move
+    int32_t (*outputLayer)(const int16_t *restrict stmAccumulator, const int16_t *restrict enemyAccumulator, const int16_t *restrict weights);
+} NNUEKernels;
+
+// Picks the widest instruction set supported by the CPU running the binary
+const NNUEKernels* selectNNUEKernels();
+
+#endif
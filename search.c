@@ -1,15 +1,17 @@
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 #include "search.h"
 #include "chess_board.h"
 #include "utility.h"
 #include "transposition_table.h"
+#include "move_generator.h"
 #include "move_selector.h"
 #include "nnue.h"
 
-constexpr Depth MAX_DEPTH = 255;
-
 typedef enum Node {
     ROOT, PV, NON_PV
 } Node;
@@ -18,6 +20,31 @@ typedef struct SearchHelper {
     Move pv[MAX_DEPTH]; // TODO: Is it worth saving space by making triangular?
 } SearchHelper;
 
+// Threads searching the current UCI position, the first thread is the main thread
+static SearchThread *searchThreads;
+static pthread_t threadIds[UINT8_MAX];
+static uint8_t numberOfSearchThreads;
+static atomic_bool stopSearch;
+static bool searching; // Only accessed by the UCI thread
+
+static inline uint64_t getTotalNodes() {
+    uint64_t nodes = 0;
+    for (int i = 0; i < numberOfSearchThreads; i++) nodes += getNodes(&searchThreads[i]);
+    return nodes;
+}
+
+// The stop flag is checked on every call, the clock only every TIME_CHECK_INTERVAL nodes. A single thread checks the
+// node limit on every call, with more threads the counters of all of them are summed at the same interval as the clock
+static inline bool outOfTime(SearchThread *st) {
+    uint64_t nodes = getNodes(st);
+    bool checkInterval = nodes >= st->nextTimeCheck;
+    if (checkInterval) st->nextTimeCheck = nodes + TIME_CHECK_INTERVAL;
+    bool outOfNodes = st->limits.nodes && (numberOfSearchThreads > 1 ? checkInterval && getTotalNodes() >= st->limits.nodes : nodes >= st->limits.nodes);
+    bool outOfClock = checkInterval && st->limits.timeNs != UINT64_MAX && getTimeNs() - st->startNs >= st->limits.timeNs;
+    if (outOfNodes || outOfClock) atomic_store_explicit(st->stop, true, memory_order_relaxed);
+    return isSearchStopped(st);
+}
+
 static inline void updatePV(Move move, Move *restrict currentPV, const Move *restrict childrenPV) {
     *currentPV++ = move;
     while((*currentPV++ = *childrenPV++));
@@ -52,29 +79,37 @@ static inline Score getRFPMargin(Depth depth) {
 }
 
 // TODO: Should eventually include seldepth
+// Only the main thread of the UCI search prints, so the nodes of all of its threads are reported
 static inline void printSearch(Depth depth, Score score, const char *restrict pvString, const SearchThread *st) {
     uint64_t time = (getTimeNs() - st->startNs) / 1000000;
-    uint64_t nps = st->nodes * 1000 / (time + 1);
+    uint64_t nodes = getTotalNodes();
+    uint64_t nps = nodes * 1000 / (time + 1);
     char *scoreType = score >= GUARANTEE_CHECKMATE || score <= -GUARANTEE_CHECKMATE ? "mate" : "cp";
     score = score >=  GUARANTEE_CHECKMATE ? ( CHECKMATE - score + 1) / 2
           : score <= -GUARANTEE_CHECKMATE ? (-CHECKMATE - score    ) / 2
           : score;
-    printf("info depth %d score %s %d nodes %llu nps %llu time %llu pv %s\n", depth, scoreType, score, st->nodes, nps, time, pvString);
+    printf("info depth %d score %s %d nodes %llu nps %llu time %llu pv %s\n", depth, scoreType, score, nodes, nps, time, pvString);
+}
+
+// The accumulator of the current ply is only brought up to date when the position is evaluated
+static inline Score evaluate(SearchThread *st) {
+    Accumulator *accumulator = &st->accumulator[st->ply];
+    updateAccumulator(accumulator, &st->refreshCache, st->board.pieces);
+    return evaluation(accumulator, st->board.sideToMove);
 }
 
 static Score quiescenceSearch(Score alpha, Score beta, SearchHelper *restrict sh, SearchThread *st) {
     ChessBoard *board = &st->board;
-    st->nodes++;
+    incrementNodes(st);
 
     /* 1) Draw Detection */
     if (isDraw(board)) return DRAW;
     /*                   */
     
     bool checkers = getCheckers(board);
-    const Accumulator *currentAccumulator = &st->accumulator[st->ply    ];
-    Accumulator       *childAccumulator   = &st->accumulator[st->ply + 1];
+    Accumulator *childAccumulator = &st->accumulator[st->ply + 1];
     /* Stand Pat */
-    Score bestScore = checkers ? -CHECKMATE + st->ply : evaluation(currentAccumulator, board->sideToMove); // TODO: Could be evaluating a stalemate
+    Score bestScore = checkers ? -CHECKMATE + st->ply : evaluate(st); // TODO: Could be evaluating a stalemate
     if (bestScore > alpha) {
         if (bestScore >= beta) return bestScore; 
         alpha = bestScore;
@@ -82,7 +117,6 @@ static Score quiescenceSearch(Score alpha, Score beta, SearchHelper *restrict sh
     /*           */
 
     /* Main Moves Loop */
-    ChessBoardHistory history;
     MoveSelector ms;
     MoveSelectorState state = checkers ? TT_MOVE : GET_NON_CAPTURE_MOVES; // TODO: Cleanup naming
     createMoveSelector(&ms, board, state, NO_MOVE);
@@ -92,8 +126,7 @@ static Score quiescenceSearch(Score alpha, Score beta, SearchHelper *restrict sh
         if (!isLegalMove(board, move)) continue;
         
         st->ply++;
-        *childAccumulator = *currentAccumulator;
-        makeMove(board, &history, childAccumulator, move);
+        makeMove(board, childAccumulator, nullptr, move);
         Score score = -quiescenceSearch(-beta, -alpha, sh, st);
         undoMove(board, move);
         st->ply--;
@@ -118,41 +151,44 @@ static Score alphaBeta(Score alpha, Score beta, Depth depth, Node node, SearchHe
     /*                      */
     
     ChessBoard *board = &st->board;
-    st->nodes++;
+    incrementNodes(st);
     /* 2) Draw Detection */
     if ((node != ROOT && isDraw(board)) || outOfTime(st)) return DRAW;
+    if (node != ROOT && alpha < DRAW && hasUpcomingRepetition(board, st->ply)) {
+        alpha = DRAW;
+        if (alpha >= beta) return alpha;
+    }
     /*                   */
 
     /* 3) Transposition Table */
     const bool isPvNode = node != NON_PV;
     bool hasEvaluation;
     Key positionKey = getPositionKey(board);
-    PositionEvaluation *pe = probeTranspositionTable(st->tt, positionKey, &hasEvaluation);
+    PositionEvaluation pe;
+    PEEntry *entry = probeTranspositionTable(st->tt, positionKey, &pe, &hasEvaluation);
     Move ttMove = NO_MOVE;
     if (hasEvaluation) {
-        if (!isPvNode && pe->depth >= depth) {
-            Bound bound = getBound(pe);
-            Score nodeScore = adjustNodeScoreFromTT(pe->nodeScore, st->ply);
+        if (!isPvNode && pe.depth >= depth) {
+            Bound bound = getBound(&pe);
+            Score nodeScore = adjustNodeScoreFromTT(pe.nodeScore, st->ply);
             if (bound == EXACT || (bound == LOWER ? nodeScore >= beta : nodeScore <= alpha)) return nodeScore;
         }
-        ttMove = pe->bestMove;
+        ttMove = pe.bestMove;
     }
     /*                        */
 
-    ChessBoardHistory history;
     SearchHelper *child = sh + 1;
-    const Accumulator *currentAccumulator = &st->accumulator[st->ply    ];
-    Accumulator       *childAccumulator   = &st->accumulator[st->ply + 1];
+    Accumulator *childAccumulator = &st->accumulator[st->ply + 1];
 
     bool checkers = getCheckers(board);
     Score staticEvaluation = checkers ? -INFINITE 
-                           : hasEvaluation ? pe->staticEvaluation
-                           : evaluation(currentAccumulator, board->sideToMove);
+                           : hasEvaluation ? pe.staticEvaluation
+                           : evaluate(st);
     /** 4) Null Move Pruning **/
     if (!isPvNode && !checkers && depth > 3 && staticEvaluation >= beta && hasNonPawnMaterial(board, board->sideToMove)) {
         st->ply++;
-        *childAccumulator = *currentAccumulator;
-        makeNullMove(board, &history);
+        resetDirtyPieces(childAccumulator);
+        makeNullMove(board);
         Score score = -alphaBeta(-beta, -beta + 1, depth - 4, NON_PV, child, st);
         undoNullMove(board);
         st->ply--;
@@ -192,8 +228,7 @@ static Score alphaBeta(Score alpha, Score beta, Depth depth, Node node, SearchHe
         /**                         **/
 
         st->ply++;
-        *childAccumulator = *currentAccumulator;
-        makeMove(board, &history, childAccumulator, move);
+        makeMove(board, childAccumulator, newDepth ? st->tt : nullptr, move);
 
         /* 10) Principal Variation Search */
         Score score;
@@ -207,7 +242,7 @@ static Score alphaBeta(Score alpha, Score beta, Depth depth, Node node, SearchHe
         if (score > bestScore) {
             if (score > alpha) {
                 if (score >= beta) {
-                    if (!st->stop) savePositionEvaluation(st->tt, pe, positionKey, move, depth, LOWER, adjustNodeScoreToTT(score, st->ply), staticEvaluation);
+                    if (!isSearchStopped(st)) savePositionEvaluation(st->tt, entry, positionKey, move, depth, LOWER, adjustNodeScoreToTT(score, st->ply), staticEvaluation);
                     return score;
                 }
                 updatePV(move, sh->pv, child->pv); // TODO: Only needs to be done once on the last score > alpha, but integrity is lost
@@ -223,10 +258,30 @@ static Score alphaBeta(Score alpha, Score beta, Depth depth, Node node, SearchHe
     if (!legalMoves) bestScore = checkers ? -CHECKMATE + st->ply : DRAW; // TODO: Should this be considered EXACT bound?
     /*                                       */
 
-    if (!st->stop) savePositionEvaluation(st->tt, pe, positionKey, bestMove, depth, bestScore > oldAlpha ? EXACT : UPPER, adjustNodeScoreToTT(bestScore == -INFINITE ? staticEvaluation : bestScore, st->ply), staticEvaluation);
+    if (!isSearchStopped(st)) savePositionEvaluation(st->tt, entry, positionKey, bestMove, depth, bestScore > oldAlpha ? EXACT : UPPER, adjustNodeScoreToTT(bestScore == -INFINITE ? staticEvaluation : bestScore, st->ply), staticEvaluation);
     return bestScore;
 }
 
+// Helpers skip some depths with Stockfish's schedule, so that the threads are spread over several
+// depths instead of searching the same trees in lockstep. Depth 1 is never skipped
+static inline bool skipDepth(const SearchThread *st, Depth depth) {
+    static const int SKIP_SIZE [] = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+    static const int SKIP_PHASE[] = {0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+    if (!st->id || depth == 1) return false;
+    int i = (st->id - 1) % 20;
+    return (depth + st->board.ply + SKIP_PHASE[i]) / SKIP_SIZE[i] % 2;
+}
+
+// A search stopped before depth 1 completes still reports a legal move, NO_MOVE only if there is none
+static Move getFirstLegalMove(const ChessBoard *restrict board) {
+    MoveObject moveList[MAX_MOVES];
+    MoveObject *endList = createMoveList(board, moveList, CAPTURES);
+    endList = createMoveList(board, endList, NON_CAPTURES);
+    for (MoveObject *moveObj = moveList; moveObj != endList; moveObj++)
+        if (isLegalMove(board, moveObj->move)) return moveObj->move;
+    return NO_MOVE;
+}
+
 void* startSearch(void *searchThread) {
     constexpr Score ASPIRATION_WINDOW = 50;
     SearchThread *st = searchThread;
@@ -236,10 +291,20 @@ void* startSearch(void *searchThread) {
     Score score, alpha = -INFINITE, beta = INFINITE;
     Depth depth = 1;
     st->startNs = getTimeNs();
-    while (depth && !outOfTime(st)) {
+    st->bestMove.move = getFirstLegalMove(&st->board);
+    if (st->limits.clockNs) {
+        createTimeManager(&st->tm, st->limits.clockNs, st->limits.incrementNs, st->limits.movesToGo);
+        st->limits.timeNs = st->tm.hardLimitNs;
+    }
+
+    while (depth && depth <= st->limits.depth && !outOfTime(st)) {
+        if (skipDepth(st, depth)) {
+            depth++;
+            continue;
+        }
         score = alphaBeta(alpha, beta, depth, ROOT, sh, st);
 
-        if (st->stop) break;
+        if (isSearchStopped(st)) break;
 
         if (score <= alpha) alpha -= ASPIRATION_WINDOW;
         else if (score >= beta) beta += ASPIRATION_WINDOW;
@@ -249,27 +314,74 @@ void* startSearch(void *searchThread) {
             
             st->bestMove.move  = sh[0].pv[0];
             st->bestMove.score = score;
+            st->ponderMove     = sh[0].pv[0] ? sh[0].pv[1] : NO_MOVE;
+            st->completedDepth = depth;
 
             if (st->print) {
                 pvToString(pvString, bestMove, ponderMove, sh[0].pv);
                 printSearch(depth, score, pvString, st);
             }
+            if (st->limits.clockNs && !startNextIteration(&st->tm, st->bestMove.move, score, getTimeNs() - st->startNs)) break;
             depth++;
         }
     }
-    if (st->print) {
-        if (ponderMove[0]) printf("bestmove %s ponder %s\n", bestMove, ponderMove);
-        else printf("bestmove %s\n", bestMove);
+    return &st->bestMove;
+}
+
+// The main thread decides when the search ends, afterwards it stops the helper threads and reports the best move
+static void* startMainSearch(void *searchThread) {
+    SearchThread *st = searchThread;
+    for (int i = 1; i < numberOfSearchThreads; i++) pthread_create(&threadIds[i], nullptr, startSearch, &searchThreads[i]);
+    startSearch(st);
+    // An infinite search that finished early must still wait for stop before reporting
+    while (st->limits.infinite && !isSearchStopped(st)) nanosleep(&(struct timespec) {.tv_nsec = 1000000}, nullptr);
+    atomic_store_explicit(st->stop, true, memory_order_relaxed);
+    for (int i = 1; i < numberOfSearchThreads; i++) pthread_join(threadIds[i], nullptr);
+
+    // Prefer the thread that completed the deepest iteration, then the highest score
+    const SearchThread *best = st;
+    for (int i = 1; i < numberOfSearchThreads; i++) {
+        const SearchThread *helper = &searchThreads[i];
+        if (helper->completedDepth > best->completedDepth || (helper->completedDepth == best->completedDepth && helper->bestMove.score > best->bestMove.score))
+            best = helper;
     }
+
+    char bestMove[6] = "0000", ponderMove[6]; // UCI null move when the position has no legal move
+    if (best->bestMove.move) moveToString(bestMove, best->bestMove.move);
+    if (best->bestMove.move && best->ponderMove) {
+        moveToString(ponderMove, best->ponderMove);
+        printf("bestmove %s ponder %s\n", bestMove, ponderMove);
+    } else printf("bestmove %s\n", bestMove);
     return &st->bestMove;
 }
 
-void startSearchThreads(UCI_Configuration *restrict config, uint64_t searchTimeNs) {
+// Lazy SMP, every thread searches the same position and shares information through the transposition table.
+// Returns immediately, the search runs in the background until it finishes or is stopped.
+void startSearchThreads(UCI_Configuration *restrict config, const SearchLimits *restrict limits) {
+    waitForSearchThreads();
     config->tt.age++;
 
-    pthread_t th;
-    SearchThread st;
-    createSearchThread(&st, &config->board, &config->tt, &config->accumulator, searchTimeNs, true);
-    pthread_create(&th, nullptr, startSearch, &st);
-    pthread_join(th, nullptr);
+    numberOfSearchThreads = config->threads;
+    searchThreads = alignedAllocate(alignof(SearchThread), sizeof(SearchThread) * numberOfSearchThreads);
+    atomic_store_explicit(&stopSearch, false, memory_order_relaxed);
+    for (int i = 0; i < numberOfSearchThreads; i++) {
+        createSearchThread(&searchThreads[i], &config->board, &config->tt, &config->accumulator, &stopSearch, i ? &NO_LIMITS : limits, !i);
+        searchThreads[i].id = i;
+    }
+
+    pthread_create(&threadIds[0], nullptr, startMainSearch, &searchThreads[0]);
+    searching = true;
+}
+
+void stopSearchThreads() {
+    atomic_store_explicit(&stopSearch, true, memory_order_relaxed);
+}
+
+void waitForSearchThreads() {
+    if (!searching) return;
+    pthread_join(threadIds[0], nullptr);
+    alignedFree(searchThreads);
+    searchThreads = nullptr;
+    numberOfSearchThreads = 0;
+    searching = false;
 }
@@ -1,25 +1,50 @@
 #ifndef SEARCH_H
 #define SEARCH_H
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <time.h>
 #include "chess_board.h"
 #include "nnue.h"
+#include "time_manager.h"
 #include "transposition_table.h"
 #include "uci.h"
 #include "utility.h"
 
+constexpr Depth MAX_DEPTH = 255;
+constexpr uint64_t TIME_CHECK_INTERVAL = 1024; // Nodes between reads of the clock, a small fraction of a millisecond
+
+// A limit is disabled when it is UINT64_MAX for time, 0 for clock and nodes, and MAX_DEPTH for depth
+typedef struct SearchLimits {
+    uint64_t timeNs; // Hard limit, replaced by the time manager when searching with a clock
+    uint64_t clockNs; // Remaining time of the side to move
+    uint64_t incrementNs;
+    uint64_t nodes; // The nodes of every thread of the search are counted
+    uint8_t movesToGo;
+    Depth depth;
+    bool infinite; // The best move is not reported until the search is stopped
+} SearchLimits;
+
+// Limits given to helper threads, they are stopped through the shared stop flag
+constexpr SearchLimits NO_LIMITS = {.timeNs = UINT64_MAX, .clockNs = 0, .incrementNs = 0, .nodes = 0, .movesToGo = 0, .depth = MAX_DEPTH, .infinite = false};
+
 typedef struct SearchThread {
-    Accumulator accumulator[512]; // TODO: Where to store accumulator and sizing. Struct alignment?
+    Accumulator accumulator[512]; // TODO: Where to store accumulator and sizing
+    RefreshCache refreshCache;
     ChessBoard board;
     TT *tt;
+    atomic_bool *stop; // Shared by every thread searching the same position
     uint64_t startNs; // TODO: Could change implementation
-    uint64_t maxSearchTimeNs;
-    uint64_t nodes;
+    SearchLimits limits;
+    TimeManager tm;
+    _Atomic uint64_t nodes; // Written only by its own thread, read by the main thread while searching
+    uint64_t nextTimeCheck; // Node count at which the clock is read next
     MoveObject bestMove;
+    Move ponderMove;
+    Depth completedDepth;
+    uint8_t id; // 0 for the main thread, helpers are numbered from 1
     uint8_t ply;
     bool print;
-    bool stop;
 } SearchThread;
 
 static inline uint64_t getTimeNs() {
@@ -28,22 +53,41 @@ static inline uint64_t getTimeNs() {
     return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
 }
 
-static inline void createSearchThread(SearchThread *st, const ChessBoard *restrict board, TT *tt, Accumulator *accumulator, uint64_t maxSearchTimeNs, bool print) {
-    st->board = *board; // TODO: The history pointer is a shallow copy, consider using a deep copy
+static inline void createSearchThread(SearchThread *st, const ChessBoard *restrict board, TT *tt, Accumulator *accumulator, atomic_bool *stop, const SearchLimits *restrict limits, bool print) {
+    st->board = *board; // Deep copy, the history stack is part of the board
     st->tt = tt;
+    st->stop = stop;
     st->accumulator[0] = *accumulator;
-    st->maxSearchTimeNs = maxSearchTimeNs;
-    st->nodes = 0;
+    resetRefreshCache(&st->refreshCache);
+    st->limits = *limits;
+    atomic_init(&st->nodes, 0);
+    st->nextTimeCheck = 0;
+    st->bestMove = (MoveObject) {0};
+    st->ponderMove = NO_MOVE;
+    st->completedDepth = 0;
+    st->id = 0;
     st->ply = 0;
     st->print = print;
-    st->stop = false;
 }
 
-static inline bool outOfTime(SearchThread *st) {
-    return st->stop = getTimeNs() - st->startNs >= st->maxSearchTimeNs;
+static inline uint64_t getNodes(const SearchThread *st) {
+    return atomic_load_explicit(&st->nodes, memory_order_relaxed);
+}
+
+// There is a single writer, so a relaxed load and store avoids the cost of a locked add
+static inline void incrementNodes(SearchThread *st) {
+    atomic_store_explicit(&st->nodes, getNodes(st) + 1, memory_order_relaxed);
+}
+
+static inline bool isSearchStopped(const SearchThread *st) {
+    return atomic_load_explicit(st->stop, memory_order_relaxed);
 }
 
 void* startSearch(void *searchThread);
-void startSearchThreads(UCI_Configuration *restrict config, uint64_t searchTimeNs);
+void startSearchThreads(UCI_Configuration *restrict config, const SearchLimits *restrict limits);
+// Signals every search thread to stop as soon as possible
+void stopSearchThreads();
+// Blocks until the search started by startSearchThreads has reported its best move
+void waitForSearchThreads();
 
 #endif
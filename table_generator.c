@@ -0,0 +1,312 @@
+// Build step that writes tables.c: every attack, line, Zobrist and cuckoo table as constant data,
+// so the engine starts without initializing anything. Usage: ./table_generator > tables.c
+#include <stdio.h>
+#include <stdlib.h>
+#include "attacks.h"
+#include "chess_board.h"
+#include "utility.h"
+
+constexpr int SLIDING_ATTACKS_SIZE = 107648; // The number of attacks for every bishop and rook square and ray occupancy
+
+typedef struct SliderEntry {
+    int offset;
+    Bitboard mask;
+    Bitboard magic;
+    int shift;
+} SliderEntry;
+
+static Bitboard pawnAttackTable[COLOURS][SQUARES];
+static Bitboard knightAttackTable[SQUARES];
+static Bitboard kingAttackTable[SQUARES];
+static Bitboard pextAttacks[SLIDING_ATTACKS_SIZE];
+static Bitboard magicAttacks[SLIDING_ATTACKS_SIZE];
+static SliderEntry sliders[SLIDERS][SQUARES];
+static Bitboard fullLineTable[SQUARES][SQUARES];
+static Bitboard inBetweenLineTable[SQUARES][SQUARES];
+static uint64_t zobristPieceOnSquare[PIECE_TYPES * COLOURS][SQUARES];
+static uint64_t zobristCastlingRights[ALL_RIGHTS + 1];
+static uint64_t zobristEnPassant[FILES];
+static uint64_t zobristSideToMove;
+static Key cuckooKeyTable[CUCKOO_SIZE];
+static Move cuckooMoveTable[CUCKOO_SIZE];
+
+static const Direction DIRECTIONS[SLIDERS][4] = {{NORTH_EAST, NORTH_WEST, SOUTH_EAST, SOUTH_WEST}, {NORTH, SOUTH, EAST, WEST}};
+
+static Bitboard initializeKnightAttacks(Bitboard knightSq) {
+    return shiftBitboard(shiftBitboard(knightSq &              ~FILE_H_BB, NORTH), NORTH_EAST)
+         | shiftBitboard(shiftBitboard(knightSq & ~FILE_G_BB & ~FILE_H_BB, EAST),  NORTH_EAST)
+         | shiftBitboard(shiftBitboard(knightSq & ~FILE_G_BB & ~FILE_H_BB, EAST),  SOUTH_EAST)
+         | shiftBitboard(shiftBitboard(knightSq &              ~FILE_H_BB, SOUTH), SOUTH_EAST)
+         | shiftBitboard(shiftBitboard(knightSq &              ~FILE_A_BB, SOUTH), SOUTH_WEST)
+         | shiftBitboard(shiftBitboard(knightSq & ~FILE_A_BB & ~FILE_B_BB, WEST),  SOUTH_WEST)
+         | shiftBitboard(shiftBitboard(knightSq & ~FILE_A_BB & ~FILE_B_BB, WEST),  NORTH_WEST)
+         | shiftBitboard(shiftBitboard(knightSq &              ~FILE_A_BB, NORTH), NORTH_WEST);
+}
+
+static Bitboard initializeKingAttacks(Bitboard kingSq) {
+    Bitboard attacks = shiftBitboard(kingSq & ~FILE_H_BB, EAST) | shiftBitboard(kingSq & ~FILE_A_BB, WEST);
+    kingSq |= attacks;
+    return attacks | shiftBitboard(kingSq, NORTH) | shiftBitboard(kingSq, SOUTH);
+}
+
+static Bitboard initializeSlidingAttacks(Slider slider, Square sq, Bitboard occupied) {
+    Bitboard attacks = 0;
+    for (int i = 0; i < 4; i++) {
+        Direction direction = DIRECTIONS[slider][i];
+        Square fromSq = sq;
+        Square toSq = moveSquareInDirection(sq, direction);
+        Bitboard toSquareBB = shiftBitboard(squareToBitboard(sq), direction);
+        while (toSquareBB && isAdjacentSquare(fromSq, toSq)) {
+            attacks |= toSquareBB;
+            if (toSquareBB & occupied) break;
+            toSquareBB = shiftBitboard(toSquareBB, direction);
+            fromSq = toSq;
+            toSq = moveSquareInDirection(fromSq, direction);
+        }
+    }
+    return attacks;
+}
+
+// The generator must run on any build machine, so pext is done in software
+static uint64_t softwarePext(uint64_t src, uint64_t mask) {
+    uint64_t result = 0;
+    for (uint64_t bit = 1; mask; bit <<= 1, mask &= mask - 1)
+        if (src & mask & -mask) result |= bit;
+    return result;
+}
+
+static uint64_t getMagicIndex(const SliderEntry *entry, Bitboard occupied) {
+    return (occupied & entry->mask) * entry->magic >> entry->shift;
+}
+
+// Finds a magic that maps every occupancy to an index holding its attacks, occupancies with the same attacks may share one.
+// Random sparse numbers with a fixed seed, the published magics assume a different square mapping
+static void findMagic(SliderEntry *restrict entry, const Bitboard *restrict occupancies, const Bitboard *restrict attacks, int size, uint64_t *restrict seed) {
+    static int epoch[4096]; // The attempt that last wrote each index, avoids clearing the table between attempts
+    static int attempt;
+    Bitboard *table = &magicAttacks[entry->offset];
+    while (true) {
+        attempt++;
+        entry->magic = random64BitNumber(seed) & random64BitNumber(seed) & random64BitNumber(seed);
+        if (populationCount(entry->mask * entry->magic >> 56) < 6) continue;
+
+        int i = 0;
+        for (; i < size; i++) {
+            uint64_t index = getMagicIndex(entry, occupancies[i]);
+            if (epoch[index] < attempt) {
+                epoch[index] = attempt;
+                table[index] = attacks[i];
+            } else if (table[index] != attacks[i]) break;
+        }
+        if (i == size) return;
+    }
+}
+
+static void initializeAttacks() {
+    for (Square sq = 0; sq < SQUARES; sq++) {
+        Bitboard sqBB = squareToBitboard(sq);
+        pawnAttackTable[WHITE][sq] = shiftBitboard(sqBB & ~FILE_H_BB, NORTH_EAST) | shiftBitboard(sqBB & ~FILE_A_BB, NORTH_WEST);
+        pawnAttackTable[BLACK][sq] = shiftBitboard(sqBB & ~FILE_H_BB, SOUTH_EAST) | shiftBitboard(sqBB & ~FILE_A_BB, SOUTH_WEST);
+        knightAttackTable[sq] = initializeKnightAttacks(sqBB);
+        kingAttackTable[sq] = initializeKingAttacks(sqBB);
+    }
+
+    Bitboard occupancies[4096], attacks[4096];
+    uint64_t seed = 728;
+    int count = 0;
+    for (Slider slider = BISHOP_SLIDER; slider < SLIDERS; slider++) {
+        for (Square sq = 0; sq < SQUARES; sq++) {
+            Bitboard edges = ((RANK_1_BB | RANK_8_BB) & ~rankBitboardOfSquare(sq)) | ((FILE_A_BB | FILE_H_BB) & ~fileBitboardOfSquare(sq));
+            SliderEntry *entry = &sliders[slider][sq];
+            entry->offset = count;
+            entry->mask = initializeSlidingAttacks(slider, sq, 0) & ~edges;
+            entry->shift = SQUARES - populationCount(entry->mask);
+
+            int size = 0;
+            Bitboard occupiedSubset = 0;
+            do {
+                occupancies[size] = occupiedSubset;
+                attacks[size++] = initializeSlidingAttacks(slider, sq, occupiedSubset);
+                occupiedSubset = (occupiedSubset - entry->mask) & entry->mask;
+            } while (occupiedSubset);
+            count += size;
+
+            for (int i = 0; i < size; i++) pextAttacks[entry->offset + softwarePext(occupancies[i], entry->mask)] = attacks[i];
+            findMagic(entry, occupancies, attacks, size, &seed);
+        }
+    }
+}
+
+static void initializeLines() {
+    for (Square sq1 = 0; sq1 < SQUARES; sq1++) {
+        int sq1Rank = squareToRank(sq1);
+        int sq1File = squareToFile(sq1);
+        Bitboard sq1BB = squareToBitboard(sq1);
+        Bitboard sq1BishopAttacks = initializeSlidingAttacks(BISHOP_SLIDER, sq1, 0);
+        Bitboard rankBB = rankBitboardOfSquare(sq1);
+        Bitboard fileBB = fileBitboardOfSquare(sq1);
+
+        for (Square sq2 = sq1 + 1; sq2 < SQUARES; sq2++) {
+            Bitboard sq2BB = squareToBitboard(sq2);
+            int rankDistance = abs((int) squareToRank(sq2) - sq1Rank);
+            int fileDistance = abs((int) squareToFile(sq2) - sq1File);
+            Bitboard line = 0;
+            Bitboard inBetween = sq1BB | sq2BB;
+            if (rankDistance == 0 || fileDistance == 0) {
+                line = rankDistance == 0 ? rankBB : fileBB;
+                inBetween |= (initializeSlidingAttacks(ROOK_SLIDER, sq1, sq2BB) & initializeSlidingAttacks(ROOK_SLIDER, sq2, sq1BB));
+            } else if (rankDistance == fileDistance) {
+                line = (sq1BishopAttacks & initializeSlidingAttacks(BISHOP_SLIDER, sq2, 0)) | sq1BB | sq2BB;
+                inBetween |= (initializeSlidingAttacks(BISHOP_SLIDER, sq1, sq2BB) & initializeSlidingAttacks(BISHOP_SLIDER, sq2, sq1BB));
+            }
+            fullLineTable[sq1][sq2] = line;
+            fullLineTable[sq2][sq1] = line;
+            inBetweenLineTable[sq1][sq2] = inBetween;
+            inBetweenLineTable[sq2][sq1] = inBetween;
+        }
+    }
+}
+
+static void initializeZobrist() {
+    uint64_t seed = 1070372;
+    for (PieceType pt = PAWN; pt < PIECE_TYPES; pt++) {
+        for (Square sq = 0; sq < SQUARES; sq++) {
+            zobristPieceOnSquare[pt][sq] = random64BitNumber(&seed);
+            zobristPieceOnSquare[pt + COLOUR_OFFSET][sq] = random64BitNumber(&seed);
+        }
+    }
+
+    for (CastlingRights cr = 0; cr < ALL_RIGHTS + 1; cr++) {
+        zobristCastlingRights[cr] = random64BitNumber(&seed);
+    }
+
+    for (File file = FILE_A; file < FILES; file++) {
+        zobristEnPassant[file] = random64BitNumber(&seed);
+    }
+
+    zobristSideToMove = random64BitNumber(&seed);
+}
+
+// https://www.chessprogramming.org/Cuckoo_Hashing
+// Every reversible move of a non pawn piece on an empty board. Moves from a to b and from b to a
+// have the same key, so only a to b is stored. Each insertion kicks out the entry in its way,
+// which is moved to its other slot until an empty slot is found
+static void initializeCuckoo() {
+    int count = 0;
+    for (Colour c = WHITE; c < COLOURS; c++) {
+        for (PieceType pt = KNIGHT; pt < PIECE_TYPES; pt++) {
+            for (Square sq1 = 0; sq1 < SQUARES; sq1++) {
+                Bitboard attacks = pt == KNIGHT ? knightAttackTable[sq1]
+                                 : pt == KING   ? kingAttackTable[sq1]
+                                 : (pt != ROOK   ? initializeSlidingAttacks(BISHOP_SLIDER, sq1, 0) : 0)
+                                 | (pt != BISHOP ? initializeSlidingAttacks(ROOK_SLIDER,   sq1, 0) : 0);
+                for (Square sq2 = sq1 + 1; sq2 < SQUARES; sq2++) {
+                    if (!(attacks & squareToBitboard(sq2))) continue;
+                    MoveObject moveObj;
+                    setMove(&moveObj, sq1, sq2, QUIET);
+                    Move move = moveObj.move;
+                    Key key = zobristPieceOnSquare[pt + COLOUR_OFFSET * c][sq1] ^ zobristPieceOnSquare[pt + COLOUR_OFFSET * c][sq2] ^ zobristSideToMove;
+                    int i = cuckooHash1(key);
+                    while (true) {
+                        Key displacedKey = cuckooKeyTable[i];
+                        Move displacedMove = cuckooMoveTable[i];
+                        cuckooKeyTable[i] = key;
+                        cuckooMoveTable[i] = move;
+                        if (displacedMove == NO_MOVE) break;
+                        key = displacedKey;
+                        move = displacedMove;
+                        i = i == cuckooHash1(key) ? cuckooHash2(key) : cuckooHash1(key);
+                    }
+                    count++;
+                }
+            }
+        }
+    }
+    if (count != CUCKOO_MOVES) {
+        fprintf(stderr, "cuckoo table has %d moves, expected %d\n", count, CUCKOO_MOVES);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void printValues(const uint64_t *values, int size) {
+    printf("{");
+    for (int i = 0; i < size; i++) printf("%s0x%016llXULL", i ? (i % 4 ? ", " : ",\n    ") : "", (unsigned long long) values[i]);
+    printf("}");
+}
+
+static void printTable(const uint64_t *values, int rows, int columns) {
+    printf("{\n");
+    for (int i = 0; i < rows; i++) {
+        printValues(&values[i * columns], columns);
+        printf(i < rows - 1 ? ",\n" : "\n");
+    }
+    printf("}");
+}
+
+static void printMoves(const Move *moves, int size) {
+    printf("{");
+    for (int i = 0; i < size; i++) printf("%s%u", i ? (i % 16 ? ", " : ",\n    ") : "", moves[i]);
+    printf("}");
+}
+
+static void printSliders(const Bitboard *attacks, bool magics) {
+    printf("static const Bitboard slidingAttacks[%d] = ", SLIDING_ATTACKS_SIZE);
+    printValues(attacks, SLIDING_ATTACKS_SIZE);
+    printf(";\n\nconst SliderAttacks sliderAttacks[SLIDERS][SQUARES] = {\n");
+    for (Slider slider = BISHOP_SLIDER; slider < SLIDERS; slider++) {
+        printf("{\n");
+        for (Square sq = 0; sq < SQUARES; sq++) {
+            const SliderEntry *entry = &sliders[slider][sq];
+            printf("    {slidingAttacks + %d, 0x%016llXULL", entry->offset, (unsigned long long) entry->mask);
+            if (magics) printf(", 0x%016llXULL, %d", (unsigned long long) entry->magic, entry->shift);
+            printf("},\n");
+        }
+        printf("},\n");
+    }
+    printf("};\n");
+}
+
+int main() {
+    initializeAttacks();
+    initializeLines();
+    initializeZobrist();
+    initializeCuckoo();
+
+    printf("// Generated by table_generator.c, do not edit\n");
+    printf("#include \"attacks.h\"\n#include \"chess_board.h\"\n\n");
+
+    printf("const Bitboard pawnAttacks[COLOURS][SQUARES] = ");
+    printTable(&pawnAttackTable[0][0], COLOURS, SQUARES);
+    printf(";\n\nconst Bitboard nonSliderAttacks[NON_SLIDERS][SQUARES] = {\n");
+    printValues(knightAttackTable, SQUARES);
+    printf(",\n");
+    printValues(kingAttackTable, SQUARES);
+    printf("\n};\n\n");
+
+    // Both slider indexings are written so that the file does not depend on the build flags
+    printf("#ifdef NO_PEXT\n");
+    printSliders(magicAttacks, true);
+    printf("#else\n");
+    printSliders(pextAttacks, false);
+    printf("#endif\n\n");
+
+    printf("const Bitboard fullLine[SQUARES][SQUARES] = ");
+    printTable(&fullLineTable[0][0], SQUARES, SQUARES);
+    printf(";\n\nconst Bitboard inBetweenLine[SQUARES][SQUARES] = ");
+    printTable(&inBetweenLineTable[0][0], SQUARES, SQUARES);
+
+    printf(";\n\nconst Zobrist zobristHashes = {\n.pieceOnSquare = ");
+    printTable(&zobristPieceOnSquare[0][0], PIECE_TYPES * COLOURS, SQUARES);
+    printf(",\n.castlingRights = ");
+    printValues(zobristCastlingRights, ALL_RIGHTS + 1);
+    printf(",\n.enPassant = ");
+    printValues(zobristEnPassant, FILES);
+    printf(",\n.sideToMove = 0x%016llXULL\n};\n", (unsigned long long) zobristSideToMove);
+
+    printf("\nconst Key cuckooKeys[CUCKOO_SIZE] = ");
+    printValues(cuckooKeyTable, CUCKOO_SIZE);
+    printf(";\n\nconst Move cuckooMoves[CUCKOO_SIZE] = ");
+    printMoves(cuckooMoveTable, CUCKOO_SIZE);
+    printf(";\n");
+    return 0;
+}
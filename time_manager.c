@@ -0,0 +1,38 @@
+#include <stdint.h>
+#include "time_manager.h"
+#include "utility.h"
+
+constexpr uint64_t MOVE_OVERHEAD_NS   = 10000000; // Reserved for communication with the GUI
+constexpr int DEFAULT_MOVES_TO_GO     = 25;
+constexpr int MAX_MOVES_TO_GO         = 50;
+constexpr int MAX_STABILITY           = 4;
+// In percent, indexed by stability. An unstable best move gets more time, an obvious move gets less
+constexpr int STABILITY_SCALE[MAX_STABILITY + 1] = {200, 140, 110, 90, 75};
+
+static inline uint64_t minU64(uint64_t a, uint64_t b) {
+    return a <= b ? a : b;
+}
+
+void createTimeManager(TimeManager *restrict tm, uint64_t clockNs, uint64_t incrementNs, int movesToGo) {
+    uint64_t available = clockNs > 2 * MOVE_OVERHEAD_NS ? clockNs - MOVE_OVERHEAD_NS : clockNs / 2;
+    movesToGo = movesToGo ? min(movesToGo, MAX_MOVES_TO_GO) : DEFAULT_MOVES_TO_GO;
+
+    tm->softLimitNs = minU64(available / movesToGo + incrementNs * 3 / 4, available / 2);
+    tm->hardLimitNs = minU64(tm->softLimitNs * 4, available * 4 / 5);
+    tm->previousBestMove = NO_MOVE;
+    tm->previousScore = 0;
+    tm->stability = 0;
+}
+
+bool startNextIteration(TimeManager *restrict tm, Move bestMove, Score score, uint64_t elapsedNs) {
+    tm->stability = bestMove == tm->previousBestMove ? min(tm->stability + 1, MAX_STABILITY) : 0;
+
+    // A score that dropped since the last iteration gets up to double the time to find a better move
+    int scoreDropScale = tm->previousBestMove ? 100 + max(0, min(tm->previousScore - score, 50)) * 2 : 100;
+    tm->previousBestMove = bestMove;
+    tm->previousScore = score;
+
+    uint64_t softLimitNs = minU64(tm->softLimitNs * STABILITY_SCALE[tm->stability] / 100 * scoreDropScale / 100, tm->hardLimitNs);
+    // The next iteration usually takes longer than all of the previous ones, so a partial one is not started
+    return elapsedNs < softLimitNs / 2;
+}
@@ -0,0 +1,23 @@
+#ifndef TIME_MANAGER_H
+#define TIME_MANAGER_H
+
+#include <stdint.h>
+#include "utility.h"
+
+// Decides how long to search when playing with a clock.
+// The soft limit is checked between iterations and is scaled by how stable the search is,
+// the hard limit aborts the search in the middle of an iteration.
+typedef struct TimeManager {
+    uint64_t softLimitNs;
+    uint64_t hardLimitNs;
+    Move previousBestMove;
+    Score previousScore;
+    int stability; // Number of consecutive iterations the best move did not change
+} TimeManager;
+
+// movesToGo == 0 means the rest of the game has to be played with the remaining time
+void createTimeManager(TimeManager *restrict tm, uint64_t clockNs, uint64_t incrementNs, int movesToGo);
+// Called after every completed iteration, returns true if there is enough time to start the next one
+bool startNextIteration(TimeManager *restrict tm, Move bestMove, Score score, uint64_t elapsedNs);
+
+#endif
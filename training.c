@@ -12,10 +12,9 @@
 #include "transposition_table.h"
 #include "utility.h"
 
-constexpr int MAX_RANDOM_MOVES = 10;
-
 typedef struct TrainingThread {
     SearchThread st;
+    atomic_bool searchStop;
     pthread_t id;
     uint64_t seed;
     FILE *file;
@@ -70,7 +69,7 @@ static inline bool isEndOfGame(const ChessBoard *restrict board, const MoveObjec
 }
 
 // Randomly plays the first 5-10 moves
-static void playRandomMoves(ChessBoard *restrict board, ChessBoardHistory *restrict history, Accumulator *restrict accumulator, TrainingThread *tt) {
+static void playRandomMoves(ChessBoard *restrict board, TrainingThread *tt) {
     int numberOfRandomMoves = random64BitNumber(&tt->seed) % 6 + 5;
     for (int i = 0; i < numberOfRandomMoves; i++) {
         MoveObject moveList[MAX_MOVES];
@@ -82,7 +81,7 @@ static void playRandomMoves(ChessBoard *restrict board, ChessBoardHistory *restr
             MoveObject *moveObj = &startList[random64BitNumber(&tt->seed) % moveListSize];
             Move move = moveObj->move;
             if (isLegalMove(board, move)) {
-                makeMove(board, &history[i], accumulator, move);
+                makeBoardMove(board, move);
                 break;
             }
             moveListSize--;
@@ -94,8 +93,8 @@ static void playRandomMoves(ChessBoard *restrict board, ChessBoardHistory *restr
 static void playGame(TrainingThread *tt, GameData *restrict previous) {
     ChessBoard *board = &tt->st.board;
     Accumulator *accumulator = tt->st.accumulator;
-    ChessBoardHistory history;
     GameData current;
+    atomic_store_explicit(&tt->searchStop, false, memory_order_relaxed);
     MoveObject *bestMove = startSearch(&tt->st);
     if (!getCheckers(board) && !isCheckmate(bestMove->score) && !insufficientMaterial(board)) { // TODO: What positions to save?
         createGameData(&current, previous, board, bestMove->score);
@@ -110,18 +109,22 @@ static void playGame(TrainingThread *tt, GameData *restrict previous) {
         writeGameData(previous, tt->file, outcome);
         return;
     }
-    makeMove(board, &history, accumulator, bestMove->move);
+    makeBoardMove(board, bestMove->move);
+    discardIrreversibleHistory(board);
+    refreshAccumulator(board, accumulator); // The root accumulator has no parent to be updated from
     playGame(tt, previous);
 }
 
 static void playRandomGame(TrainingThread *tt) {
     ChessBoard board;
-    ChessBoardHistory history[MAX_RANDOM_MOVES + 1];
     Accumulator accumulator;
     GameData dummy = {.prev = nullptr};
-    parseFEN(&board, history, &accumulator, START_POS);
-    playRandomMoves(&board, &history[1], &accumulator, tt);
-    createSearchThread(&tt->st, &board, tt->st.tt, &accumulator, 1000000000 / 8, false);
+    parseFEN(&board, nullptr, START_POS);
+    playRandomMoves(&board, tt);
+    refreshAccumulator(&board, &accumulator);
+    SearchLimits limits = NO_LIMITS;
+    limits.timeNs = 1000000000 / 8;
+    createSearchThread(&tt->st, &board, tt->st.tt, &accumulator, &tt->searchStop, &limits, false);
     playGame(tt, &dummy); // TODO: Is it safe to write data for position that randomly is draw?
 }
 
@@ -129,7 +132,7 @@ static void* startTraining(void *trainingThread) {
     TrainingThread *tt = trainingThread;
     while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
         playRandomGame(tt);
-        clearTranspositionTable(tt->st.tt);
+        clearTranspositionTable(tt->st.tt, 1);
     }
     return nullptr;
 }
@@ -169,7 +172,7 @@ void startTrainingThreads(const UCI_Configuration *restrict config) {
         random = random64BitNumber(&random);
         snprintf(filename, sizeof(filename), "training_data%02d.txt", i); // TODO: Make directory
         tth[i].st.tt = &transpositionTable[i];
-        createTranspositionTable(&transpositionTable[i], config->hashSize);
+        createTranspositionTable(&transpositionTable[i], config->hashSize, 1);
         startTrainingThread(&tth[i], random, filename);
     }
 }
@@ -0,0 +1,105 @@
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+#include "transposition_table.h"
+
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+typedef struct ClearTask {
+    PEBucket *buckets;
+    size_t numberOfBuckets;
+} ClearTask;
+
+#ifdef __linux__
+// Transparent huge pages are unavailable if the kernel has them set to never
+static bool hugePagesEnabled() {
+    char mode[128] = "";
+    FILE *file = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+    if (!file) return false;
+    bool read = fgets(mode, sizeof(mode), file);
+    fclose(file);
+    return read && !strstr(mode, "[never]");
+}
+#endif
+
+// Large tables are probed randomly, so backing them with 2MB pages removes most of the TLB misses.
+// Falls back to cache line aligned memory when huge pages cannot be used.
+static void* allocateBuckets(size_t size) {
+#ifdef __linux__
+    if (size >= HUGE_PAGE_SIZE && hugePagesEnabled()) {
+        void *buckets = alignedAllocate(HUGE_PAGE_SIZE, size);
+        if (buckets) {
+            madvise(buckets, (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE, MADV_HUGEPAGE); // Only a request
+            return buckets;
+        }
+    }
+#endif
+    return alignedAllocate(alignof(PEBucket), size);
+}
+
+static void* clearBuckets(void *clearTask) {
+    const ClearTask *task = clearTask;
+    memset(task->buckets, 0, sizeof(PEBucket) * task->numberOfBuckets);
+    return nullptr;
+}
+
+bool createTranspositionTable(TT *restrict tt, size_t mb, int threads) {
+    size_t numberOfBuckets = mb * 1024 * 1024 / sizeof(PEBucket); // Convert megabytes to bytes first
+    PEBucket *buckets = allocateBuckets(numberOfBuckets * sizeof(PEBucket));
+    if (!buckets) return false;
+    alignedFree(tt->buckets);
+    tt->buckets = buckets;
+    tt->numberOfBuckets = numberOfBuckets;
+    clearTranspositionTable(tt, threads); // Faults in every page now instead of during the search
+    return true;
+}
+
+// The kernel may still back an madvised range with 4KB pages, so the AnonHugePages of every
+// mapping that overlaps the table is read back once the pages have been touched
+size_t getHugePageBytes(const TT *restrict tt) {
+    size_t bytes = 0;
+#ifdef __linux__
+    FILE *smaps = fopen("/proc/self/smaps", "r");
+    if (!smaps) return 0;
+    uintptr_t tableStart = (uintptr_t) tt->buckets, tableEnd = tableStart + tt->numberOfBuckets * sizeof(PEBucket);
+    bool overlaps = false;
+    char line[512];
+    while (fgets(line, sizeof(line), smaps)) {
+        unsigned long start, end;
+        size_t kilobytes;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) overlaps = start < tableEnd && end > tableStart;
+        else if (overlaps && sscanf(line, "AnonHugePages: %zu kB", &kilobytes) == 1) bytes += kilobytes * 1024;
+    }
+    fclose(smaps);
+#endif
+    return bytes;
+}
+
+void destroyTranspositionTable(TT *restrict tt) {
+    alignedFree(tt->buckets);
+}
+
+// Every thread zeroes its own contiguous slice, which is the first touch of those pages after an allocation.
+// The threads are not pinned, so spreading the pages across NUMA nodes is best effort: it depends on
+// where the scheduler runs each thread while it clears
+void clearTranspositionTable(TT *restrict tt, int threads) {
+    pthread_t th[UINT8_MAX];
+    ClearTask tasks[UINT8_MAX];
+    threads = max(threads, 1);
+    size_t bucketsPerThread = tt->numberOfBuckets / threads;
+
+    for (int i = 0; i < threads; i++) {
+        tasks[i].buckets = tt->buckets + bucketsPerThread * i;
+        tasks[i].numberOfBuckets = i == threads - 1 ? tt->numberOfBuckets - bucketsPerThread * i : bucketsPerThread;
+    }
+    for (int i = 1; i < threads; i++) pthread_create(&th[i], nullptr, clearBuckets, &tasks[i]);
+    clearBuckets(&tasks[0]);
+    for (int i = 1; i < threads; i++) pthread_join(th[i], nullptr);
+    tt->age = -1;
+}
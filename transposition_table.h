@@ -1,57 +1,83 @@
 #ifndef TRANSPOSITION_TABLE_H
 #define TRANSPOSITION_TABLE_H
 
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
-#include <string.h>
 #include "utility.h"
 
-constexpr int BUCKET_SIZE = 3; // TODO: Find optimal size
+constexpr size_t CACHE_LINE_SIZE = 64;
+constexpr int BUCKET_SIZE = 4; // Fills exactly one cache line
 
+// Unpacked copy of an entry, packs into exactly 64 bits
 typedef struct PositionEvaluation {
-    uint16_t key;
     int16_t nodeScore;
     int16_t staticEvaluation;
     Move bestMove;
-    Depth depth;
+    Depth depth; // A depth of 0 represents an empty entry
     uint8_t ageBounds;
 } PositionEvaluation;
 
+// Lockless entry: https://www.chessprogramming.org/Shared_Hash_Table#Lockless
+// The key is stored XORed with the data, so an entry torn by another thread fails the key check and is ignored
+typedef struct PositionEvaluationEntry {
+    _Atomic Key keyXorData;
+    _Atomic uint64_t data;
+} PEEntry;
+
+// Aligned so that a probe only ever touches a single cache line
 typedef struct PositionEvaluationBucket {
-    PositionEvaluation pe[BUCKET_SIZE];
+    alignas(CACHE_LINE_SIZE) PEEntry entries[BUCKET_SIZE];
 } PEBucket;
 
+static_assert(sizeof(PEBucket) == CACHE_LINE_SIZE);
+
 typedef struct TranspositionTable {
     PEBucket *buckets;
-    uint64_t mask; // TODO: Could mask be smaller?
+    uint64_t numberOfBuckets;
     uint8_t age;
 } TT;
 
-// Can be called multiple times but the first call must have tt->buckets == nullptr for the forced call to free()
-static inline void createTranspositionTable(TT *restrict tt, size_t mb) {
-    size_t numberOfBuckets = mb * 1024 * 1024 / sizeof(PEBucket); // Convert megabytes to bytes first
-    
-    // Rounds down to the nearest largest power of 2, this may cause substantially less space allocation than what was requested
-    numberOfBuckets = squareToBitboard(bitboardToSquareMSB(numberOfBuckets));
-    free(tt->buckets);
-    tt->buckets = calloc(numberOfBuckets, sizeof(PEBucket));
-    tt->mask = numberOfBuckets - 1;
-    tt->age = -1;
+// Can be called multiple times but the first call must have tt->buckets == nullptr for the forced free.
+// Returns false and keeps the current table if the memory could not be allocated
+bool createTranspositionTable(TT *restrict tt, size_t mb, int threads);
+// The number of bytes of the table that the kernel actually backs with huge pages
+size_t getHugePageBytes(const TT *restrict tt);
+void destroyTranspositionTable(TT *restrict tt);
+// Clears the table using the given number of threads
+void clearTranspositionTable(TT *restrict tt, int threads);
+
+// Maps the key uniformly onto any number of buckets: https://lemire.me/blog/2016/06/27/a-fast-alternative-to-the-modulo-reduction/
+static inline PEBucket* getBucket(const TT *tt, Key positionKey) {
+    return &tt->buckets[(__uint128_t) positionKey * tt->numberOfBuckets >> 64];
 }
 
-static inline void destroyTranspositionTable(TT *restrict tt) {
-    free(tt->buckets);
-}
-
-static inline void clearTranspositionTable(TT *restrict tt) {
-    memset(tt->buckets, 0, sizeof(PEBucket) * (tt->mask + 1));
-    tt->age = -1;
+static inline void prefetchTranspositionTable(const TT *tt, Key positionKey) {
+    __builtin_prefetch(getBucket(tt, positionKey));
 }
 
 static inline Bound getBound(const PositionEvaluation *pe) {
     return pe->ageBounds & 0x3;
 }
 
+static inline uint64_t packPositionEvaluation(const PositionEvaluation *pe) {
+    return (uint64_t) pe->bestMove 
+         | (uint64_t) (uint16_t) pe->nodeScore        << 16 
+         | (uint64_t) (uint16_t) pe->staticEvaluation << 32 
+         | (uint64_t) pe->depth                       << 48 
+         | (uint64_t) pe->ageBounds                   << 56;
+}
+
+static inline PositionEvaluation unpackPositionEvaluation(uint64_t data) {
+    return (PositionEvaluation) {
+        .bestMove         = data,
+        .nodeScore        = (int16_t) (data >> 16),
+        .staticEvaluation = (int16_t) (data >> 32),
+        .depth            = data >> 48,
+        .ageBounds        = data >> 56
+    };
+}
+
 static inline Score adjustNodeScoreToTT(Score nodeScore, int ply) {
     return nodeScore >=  GUARANTEE_CHECKMATE ? nodeScore + ply
          : nodeScore <= -GUARANTEE_CHECKMATE ? nodeScore - ply
@@ -65,39 +91,47 @@ static inline Score adjustNodeScoreFromTT(Score nodeScore, int ply) {
 }
 
 // TODO: Need to ensure that function is called correctly due to type conversions
-static inline void savePositionEvaluation(TT *tt, PositionEvaluation *pe, Key positionKey, Move bestMove, Depth depth, Bound bound, int16_t nodeScore, int16_t staticEvaluation) {
-    uint16_t positionKeyIndex = positionKey >> 48;
+static inline void savePositionEvaluation(const TT *tt, PEEntry *entry, Key positionKey, Move bestMove, Depth depth, Bound bound, int16_t nodeScore, int16_t staticEvaluation) {
+    uint64_t data = atomic_load_explicit(&entry->data, memory_order_relaxed);
+    bool samePosition = (atomic_load_explicit(&entry->keyXorData, memory_order_relaxed) ^ data) == positionKey;
+    PositionEvaluation pe = unpackPositionEvaluation(data);
     // TODO: How much to value an exact bound? Or even potentially other bounds?
     // Protect more valuable data from being overwritten
-    if (positionKeyIndex != pe->key || depth > pe->depth) {
-        pe->bestMove = bestMove;
-        pe->depth = depth;
-        pe->ageBounds = bound;
-        pe->nodeScore = nodeScore;
+    if (!samePosition || depth > pe.depth) {
+        pe.bestMove = bestMove;
+        pe.depth = depth;
+        pe.ageBounds = bound;
+        pe.nodeScore = nodeScore;
     }
-    pe->staticEvaluation = staticEvaluation;
-    pe->ageBounds = tt->age << 2 | getBound(pe);
-    pe->key = positionKeyIndex;
+    pe.staticEvaluation = staticEvaluation;
+    pe.ageBounds = tt->age << 2 | getBound(&pe);
+
+    data = packPositionEvaluation(&pe);
+    atomic_store_explicit(&entry->data, data, memory_order_relaxed);
+    atomic_store_explicit(&entry->keyXorData, positionKey ^ data, memory_order_relaxed);
 }
 
-// TODO: Consider thread safety
-static inline PositionEvaluation* probeTranspositionTable(const TT *tt, Key positionKey, bool *restrict hasEvaluation) {
-    PositionEvaluation* pe = &tt->buckets[positionKey & tt->mask].pe[0];
-    uint16_t keyIndex = positionKey >> 48;
+// Returns the entry to save the position into. If the position is found, a copy of it is placed in pe
+static inline PEEntry* probeTranspositionTable(const TT *tt, Key positionKey, PositionEvaluation *restrict pe, bool *restrict hasEvaluation) {
+    PEEntry *entries = getBucket(tt, positionKey)->entries;
+    Depth depths[BUCKET_SIZE];
 
     for (int i = 0; i < BUCKET_SIZE; i++) {
-        if (pe[i].key == keyIndex || !pe[i].key) {
-            *hasEvaluation = pe[i].key;
-            return &pe[i];
+        uint64_t data = atomic_load_explicit(&entries[i].data, memory_order_relaxed);
+        *pe = unpackPositionEvaluation(data);
+        if ((atomic_load_explicit(&entries[i].keyXorData, memory_order_relaxed) ^ data) == positionKey || !pe->depth) {
+            *hasEvaluation = pe->depth;
+            return &entries[i];
         }
+        depths[i] = pe->depth;
     }
 
     // Depth preferred replacement
-    PositionEvaluation *replace = pe;
+    int replace = 0;
     for (int i = 1; i < BUCKET_SIZE; i++)
-        if (replace->depth > pe[i].depth) replace = &pe[i];
+        if (depths[replace] > depths[i]) replace = i;
     *hasEvaluation = false;
-    return replace;
+    return &entries[replace];
 }
 
 #endif
@@ -1,9 +1,11 @@
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
-#include <time.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include "uci.h"
+#include "bench.h"
 #include "chess_board.h"
 #include "move_generator.h"
 #include "nnue.h"
@@ -18,41 +20,180 @@ constexpr char IS_READY    [] = "isready"   ;
 constexpr char POSITION    [] = "position"  ;
 constexpr char QUIT        [] = "quit"      ;
 constexpr char SET_OPTION  [] = "setoption" ;
+constexpr char STOP        [] = "stop"      ;
 constexpr char UCI         [] = "uci"       ;
 constexpr char UCI_NEW_GAME[] = "ucinewgame";
 
 // Unofficial UCI Commands
+constexpr char BENCH    [] = "bench"    ;
 constexpr char BENCHMARK[] = "benchmark";
 constexpr char EVAL     [] = "eval"     ;
 constexpr char FEN      [] = "fen"      ;
 constexpr char TRAIN    [] = "train"    ;
 
-static ChessBoardHistory histories[1024]; // TODO: New design? Can use position halfmove clock to determine max size
+// Lockless like the transposition table, the data is the node count shifted above the depth
+typedef struct PerftEntry {
+    _Atomic Key keyXorData;
+    _Atomic uint64_t data;
+} PerftEntry;
+
+// Shared by all threads, a table without entries disables hashing
+typedef struct PerftTable {
+    PerftEntry *entries;
+    uint64_t numberOfEntries;
+} PerftTable;
+
+static inline PerftEntry* getPerftEntry(const PerftTable *table, Key positionKey) {
+    return &table->entries[(__uint128_t) positionKey * table->numberOfEntries >> 64];
+}
+
+static bool probePerftTable(const PerftTable *restrict table, Key positionKey, Depth depth, uint64_t *restrict nodes) {
+    const PerftEntry *entry = getPerftEntry(table, positionKey);
+    uint64_t data = atomic_load_explicit(&entry->data, memory_order_relaxed);
+    if ((atomic_load_explicit(&entry->keyXorData, memory_order_relaxed) ^ data) != positionKey || (Depth) data != depth) return false;
+    *nodes = data >> 8;
+    return true;
+}
+
+static void savePerftTable(const PerftTable *table, Key positionKey, Depth depth, uint64_t nodes) {
+    PerftEntry *entry = getPerftEntry(table, positionKey);
+    uint64_t data = nodes << 8 | depth;
+    atomic_store_explicit(&entry->keyXorData, positionKey ^ data, memory_order_relaxed);
+    atomic_store_explicit(&entry->data, data, memory_order_relaxed);
+}
+
+// Leaves are bulk counted, moves are never made at depth 1
+static uint64_t perftNodes(ChessBoard *restrict board, const PerftTable *restrict table, Depth depth) {
+    uint64_t nodes = 0;
+    Key positionKey = getPositionKey(board);
+    if (table->entries && depth > 1 && probePerftTable(table, positionKey, depth, &nodes)) return nodes;
+
+    MoveObject moveList[MAX_MOVES];
+    MoveObject *endList = createMoveList(board, moveList, CAPTURES);
+    endList = createMoveList(board, endList, NON_CAPTURES);
+    if (depth == 1)
+        for (MoveObject *moveObj = moveList; moveObj != endList; moveObj++) 
+            nodes += isLegalMove(board, moveObj->move);
+    else 
+        for (MoveObject *moveObj = moveList; moveObj != endList; moveObj++) {
+            Move move = moveObj->move;
+            if (!isLegalMove(board, move)) continue;
+            makeBoardMove(board, move);
+            nodes += perftNodes(board, table, depth - 1);
+            undoMove(board, move);
+        }
+
+    if (table->entries && depth > 1) savePerftTable(table, positionKey, depth, nodes);
+    return nodes;
+}
+
+// Root moves are handed out to the threads one at a time, each thread searches its own copy of the board
+typedef struct PerftDivide {
+    const ChessBoard *board;
+    MoveObject moves[MAX_MOVES];
+    uint64_t nodes[MAX_MOVES];
+    size_t numberOfMoves;
+    atomic_size_t nextMove;
+    PerftTable table;
+    Depth depth;
+} PerftDivide;
+
+static void* runPerftDivide(void *perftDivide) {
+    PerftDivide *divide = perftDivide;
+    ChessBoard board = *divide->board;
+    size_t i;
+    while ((i = atomic_fetch_add_explicit(&divide->nextMove, 1, memory_order_relaxed)) < divide->numberOfMoves) {
+        Move move = divide->moves[i].move;
+        if (divide->depth == 1) {
+            divide->nodes[i] = 1;
+            continue;
+        }
+        makeBoardMove(&board, move);
+        divide->nodes[i] = perftNodes(&board, &divide->table, divide->depth - 1);
+        undoMove(&board, move);
+    }
+    return nullptr;
+}
+
+constexpr size_t PERFT_HASH_SIZE = 64; // MB, independent of the Hash option so that a large TT is not allocated twice
+
+// Prints the number of positions after each legal root move, used to find move generation bugs
+static void perftDivide(const UCI_Configuration *restrict config, Depth depth, size_t mb) {
+    pthread_t th[UINT8_MAX];
+    PerftDivide *divide = calloc(1, sizeof(PerftDivide));
+    divide->board = &config->board;
+    divide->depth = max(depth, 1);
+    atomic_init(&divide->nextMove, 0);
+    divide->table.numberOfEntries = mb * 1024 * 1024 / sizeof(PerftEntry);
+    divide->table.entries = mb ? calloc(divide->table.numberOfEntries, sizeof(PerftEntry)) : nullptr; // 0 MB disables the table
+
+    MoveObject moveList[MAX_MOVES];
+    MoveObject *endList = createMoveList(&config->board, moveList, CAPTURES);
+    endList = createMoveList(&config->board, endList, NON_CAPTURES);
+    for (MoveObject *moveObj = moveList; moveObj != endList; moveObj++)
+        if (isLegalMove(&config->board, moveObj->move)) divide->moves[divide->numberOfMoves++] = *moveObj;
+
+    uint64_t startNs = getTimeNs();
+    for (int i = 1; i < config->threads; i++) pthread_create(&th[i], nullptr, runPerftDivide, divide);
+    runPerftDivide(divide);
+    for (int i = 1; i < config->threads; i++) pthread_join(th[i], nullptr);
+    uint64_t elapsedNs = getTimeNs() - startNs + 1; // Avoids dividing by zero
+
+    uint64_t nodes = 0;
+    char moveString[6];
+    for (size_t i = 0; i < divide->numberOfMoves; i++) {
+        moveToString(moveString, divide->moves[i].move);
+        printf("%s: %llu\n", moveString, divide->nodes[i]);
+        nodes += divide->nodes[i];
+    }
+    printf("info string perft depth: %u, nodes: %llu, time: %llu ms, nodes/sec: %llu\n", divide->depth, nodes, elapsedNs / 1000000, nodes * 1000000000 / elapsedNs);
+    free(divide->table.entries);
+    free(divide);
+}
 
 static void go(UCI_Configuration *restrict config) {
-    constexpr char binc [] = "binc" ;
-    constexpr char btime[] = "btime";
-    constexpr char depth[] = "depth";
-    constexpr char winc [] = "winc" ;
-    constexpr char wtime[] = "wtime";
-    // TODO: Options to potentially implement. All times are in msec
-    //constexpr char nodes   [] = "nodes"   ;
-    //constexpr char movetime[] = "movetime";
-    //constexpr char infinite[] = "infinite";
-
-    uint64_t bIncNs, bTimeNs, wIncNs, wTimeNs, stmSearchTimeNs, searchTimeNs;
-    bIncNs = bTimeNs = wIncNs = wTimeNs = stmSearchTimeNs = searchTimeNs = 0;
+    constexpr char binc     [] = "binc"     ;
+    constexpr char btime    [] = "btime"    ;
+    constexpr char depth    [] = "depth"    ;
+    constexpr char infinite [] = "infinite" ;
+    constexpr char movestogo[] = "movestogo";
+    constexpr char movetime [] = "movetime" ;
+    constexpr char nodes    [] = "nodes"    ;
+    constexpr char perft    [] = "perft"    ;
+    constexpr char winc     [] = "winc"     ;
+    constexpr char wtime    [] = "wtime"    ;
+    // All times are in msec
+
+    SearchLimits limits = NO_LIMITS;
+    uint64_t bIncNs, bTimeNs, wIncNs, wTimeNs, moveTimeNs;
+    bIncNs = bTimeNs = wIncNs = wTimeNs = moveTimeNs = 0;
     char *token;
     while ((token = strtok(nullptr, " ")))
-        if      (strcmp(token, binc    ) == 0) bIncNs = strtoull(strtok(nullptr, " "), nullptr, 10) * 1000000;
-        else if (strcmp(token, btime   ) == 0) bTimeNs = strtoull(strtok(nullptr, " "), nullptr, 10) * 1000000;
-        else if (strcmp(token, depth   ) == 0) strtok(nullptr, " ");
-        else if (strcmp(token, winc    ) == 0) wIncNs = strtoull(strtok(nullptr, " "), nullptr, 10) * 1000000;
-        else if (strcmp(token, wtime   ) == 0) wTimeNs = strtoull(strtok(nullptr, " "), nullptr, 10) * 1000000;
+        if      (strcmp(token, binc     ) == 0) bIncNs = strtoull(strtok(nullptr, " "), nullptr, 10) * 1000000;
+        else if (strcmp(token, btime    ) == 0) bTimeNs = strtoull(strtok(nullptr, " "), nullptr, 10) * 1000000;
+        else if (strcmp(token, depth    ) == 0) limits.depth = max(1, min(strtoul(strtok(nullptr, " "), nullptr, 10), MAX_DEPTH));
+        else if (strcmp(token, infinite ) == 0) limits.infinite = true;
+        else if (strcmp(token, movestogo) == 0) limits.movesToGo = min(strtoul(strtok(nullptr, " "), nullptr, 10), UINT8_MAX);
+        else if (strcmp(token, movetime ) == 0) moveTimeNs = strtoull(strtok(nullptr, " "), nullptr, 10) * 1000000;
+        else if (strcmp(token, nodes    ) == 0) limits.nodes = strtoull(strtok(nullptr, " "), nullptr, 10);
+        else if (strcmp(token, perft    ) == 0) {
+            // go perft <depth> [hash MB]
+            Depth perftDepth = min(strtoul(strtok(nullptr, " "), nullptr, 10), MAX_DEPTH);
+            char *hashSize = strtok(nullptr, " ");
+            perftDivide(config, perftDepth, hashSize ? strtoull(hashSize, nullptr, 10) : PERFT_HASH_SIZE);
+            return;
+        }
+        else if (strcmp(token, winc     ) == 0) wIncNs = strtoull(strtok(nullptr, " "), nullptr, 10) * 1000000;
+        else if (strcmp(token, wtime    ) == 0) wTimeNs = strtoull(strtok(nullptr, " "), nullptr, 10) * 1000000;
 
-    stmSearchTimeNs = config->board.sideToMove ? bTimeNs / 20 + bIncNs / 2 : wTimeNs / 20 + wIncNs / 2;
-    searchTimeNs = stmSearchTimeNs ? stmSearchTimeNs : 1000000000;
-    startSearchThreads(config, searchTimeNs);
+    uint64_t clockNs = config->board.sideToMove ? bTimeNs : wTimeNs;
+    if (limits.infinite) limits.timeNs = UINT64_MAX;
+    else if (moveTimeNs) limits.timeNs = moveTimeNs;
+    else if (clockNs) {
+        limits.clockNs = clockNs; // The time manager decides the time limits
+        limits.incrementNs = config->board.sideToMove ? bIncNs : wIncNs;
+    } else if (limits.depth == MAX_DEPTH && !limits.nodes) limits.timeNs = 1000000000; // No limits were given
+    startSearchThreads(config, &limits);
 }
 
 static void isReady() {
@@ -61,7 +202,6 @@ static void isReady() {
 
 static void processMoves(ChessBoard *restrict board, Accumulator *restrict accumulator) {
     char *moveStr;
-    int i = 1;
     while ((moveStr = strtok(nullptr, " "))) {
         MoveObject moveList[MAX_MOVES];
         // TODO: Make a legal move generation stage
@@ -71,11 +211,13 @@ static void processMoves(ChessBoard *restrict board, Accumulator *restrict accum
         for (MoveObject *startList = moveList; startList < endList; startList++) {
             moveToString(moveToName, startList->move);
             if (strcmp(moveStr, moveToName) == 0) {
-                makeMove(board, &histories[i++], accumulator, startList->move);
+                makeBoardMove(board, startList->move);
+                discardIrreversibleHistory(board);
                 break;
             }
         }
     }
+    refreshAccumulator(board, accumulator);
 }
 
 // TODO: Fix setting FEN because of halfmove clock
@@ -88,79 +230,149 @@ static void position(ChessBoard *restrict board, Accumulator *restrict accumulat
         for (int i = 0; i < 5; i++) *(strtok(nullptr, " ") - 1) = ' ';
     }
 
-    parseFEN(board, &histories[0], accumulator, fenStr);
+    parseFEN(board, accumulator, fenStr);
     if (strtok(nullptr, " ")) processMoves(board, accumulator); // Assumes token is "moves" if there
 }
 
+static void resizeTranspositionTable(UCI_Configuration *restrict config, size_t hashSize) {
+    if (createTranspositionTable(&config->tt, hashSize, config->threads)) {
+        config->hashSize = hashSize;
+        printf("info string hash %zu MB, huge pages %zu MB\n", config->hashSize, getHugePageBytes(&config->tt) / (1024 * 1024));
+    } else if (config->tt.buckets) {
+        printf("info string error: hash of %zu MB could not be allocated, keeping %zu MB\n", hashSize, config->hashSize);
+    } else {
+        printf("info string error: hash of %zu MB could not be allocated\n", hashSize);
+        exit(EXIT_FAILURE);
+    }
+}
+
 static void setOption(UCI_Configuration *restrict config) {
-    constexpr char Hash   [] = "Hash"   ;
-    constexpr char Threads[] = "Threads";
+    constexpr char EvalFile[] = "EvalFile";
+    constexpr char Hash    [] = "Hash"    ;
+    constexpr char Threads [] = "Threads" ;
 
     
     strtok(nullptr, " "); // Discard name string
     char *token = strtok(nullptr, " ");
     strtok(nullptr, " "); // Discard value string
 
-    if      (strcmp(token, Hash   ) == 0) createTranspositionTable(&config->tt, config->hashSize = strtoull(strtok(nullptr, " "), nullptr, 10));
-    else if (strcmp(token, Threads) == 0) config->threads = strtoul(strtok(nullptr, " "), nullptr, 10);
+    if (strcmp(token, EvalFile) == 0) {
+        if (loadNetwork(strtok(nullptr, ""))) refreshAccumulator(&config->board, &config->accumulator); // The path may contain spaces
+    } else if (strcmp(token, Hash) == 0) {
+        size_t hashSize = strtoull(strtok(nullptr, " "), nullptr, 10);
+        resizeTranspositionTable(config, hashSize ? hashSize : 1); // An empty table has no bucket to map the keys onto
+    } else if (strcmp(token, Threads) == 0) {
+        unsigned long threads = strtoul(strtok(nullptr, " "), nullptr, 10);
+        threads = threads < 1 ? 1 : threads > UINT8_MAX ? UINT8_MAX : threads; // Zero threads would search nothing
+        if (threads == config->threads) return;
+        config->threads = threads;
+        resizeTranspositionTable(config, config->hashSize); // The pages are first touched again by the new threads
+    }
 }
 
 static void uci() {
     puts("id name Revolver 2.0");
     puts("id author Deshawn Mohan");
-    puts("option name Hash type spin default 16 min 1 max 1024"); // TODO: What to make max?
-    puts("option name Threads type spin default 1 min 1 max 255");
+    printf("option name EvalFile type string default %s\n", DEFAULT_NETWORK);
+    puts("option name Threads type spin default 1 min 1 max 255"); // Before Hash so that GUIs size the table after setting the threads
+    puts("option name Hash type spin default 16 min 1 max 33554432");
+    printf("info string nnue kernels %s\n", getNNUEKernelsName());
     puts("uciok");
 }
 
-static void uciNewGame(TT *restrict tt) {
-    clearTranspositionTable(tt);
+static void uciNewGame(UCI_Configuration *restrict config) {
+    clearTranspositionTable(&config->tt, config->threads);
 }
 
-static uint64_t perft(ChessBoard *restrict board, Depth depth) {
-    uint64_t nodes = 0;
-    ChessBoardHistory history;
-    MoveObject moveList[MAX_MOVES];
-    MoveObject *endList = createMoveList(board, moveList, CAPTURES);
-    endList = createMoveList(board, endList, NON_CAPTURES);
-    if (depth == 1)
-        for (MoveObject *moveObj = moveList; moveObj != endList; moveObj++) 
-            nodes += isLegalMove(board, moveObj->move);
-    else 
-        for (MoveObject *moveObj = moveList; moveObj != endList; moveObj++) {
-            Move move = moveObj->move;
-            if (!isLegalMove(board, move)) continue;
-            makeMove(board, &history, nullptr, move);
-            nodes += perft(board, depth - 1);
-            undoMove(board, move);
-        }
-    return nodes;
+typedef struct PerftTask {
+    char fen[128];
+    uint64_t expectedNodes;
+    uint64_t nodes;
+} PerftTask;
+
+// Positions of the perft suite are handed out to the threads one at a time
+typedef struct PerftSuite {
+    PerftTask *tasks;
+    size_t numberOfTasks;
+    atomic_size_t nextTask;
+    PerftTable table;
+    Depth depth;
+} PerftSuite;
+
+static void* runPerftTasks(void *perftSuite) {
+    PerftSuite *suite = perftSuite;
+    size_t i;
+    while ((i = atomic_fetch_add_explicit(&suite->nextTask, 1, memory_order_relaxed)) < suite->numberOfTasks) {
+        ChessBoard board;
+        parseFEN(&board, nullptr, suite->tasks[i].fen);
+        suite->tasks[i].nodes = perftNodes(&board, &suite->table, suite->depth);
+    }
+    return nullptr;
 }
 
-static void benchmark() {
-    Depth depth = strtoul(strtok(nullptr, " "), nullptr, 10);
+// Each line of the perft file is a FEN followed by the expected number of positions for depths 1, 2, 3...
+static size_t readPerftTasks(PerftTask **tasks, Depth depth) {
     FILE *perftFile = fopen("perft_test_cases.txt", "r");
+    if (!perftFile) return 0;
+
+    size_t numberOfTasks = 0, capacity = 1024;
     char line[256];
+    *tasks = malloc(sizeof(PerftTask) * capacity);
+    while (fgets(line, sizeof(line), perftFile)) {
+        if (numberOfTasks == capacity) *tasks = realloc(*tasks, sizeof(PerftTask) * (capacity *= 2));
+        PerftTask *task = &(*tasks)[numberOfTasks++];
+        char *fen = strtok(line, ",");
+        int fields = 1;
+        for (char *ch = fen; *ch; ch++) fields += *ch == ' ';
+        snprintf(task->fen, sizeof(task->fen), fields < 6 ? "%s 0 1" : "%s", fen); // Some FENs have no move counters
+
+        char *expected = nullptr;
+        for (int i = 0; i < depth && (expected = strtok(nullptr, ",")); i++);
+        task->expectedNodes = expected ? strtoull(expected, nullptr, 10) : 0;
+    }
+    fclose(perftFile);
+    return numberOfTasks;
+}
+
+static void benchmark(int threads) {
+    pthread_t th[UINT8_MAX];
+    PerftSuite suite = {.depth = strtoul(strtok(nullptr, " "), nullptr, 10)};
+    atomic_init(&suite.nextTask, 0);
+    char *hashSize = strtok(nullptr, " "); // Optional size of the perft hash table in MB
+    size_t mb = hashSize ? strtoull(hashSize, nullptr, 10) : 0;
+    printf("info string benchmark starting, depth: %u, threads: %d, hash: %zu MB\n", suite.depth, threads, mb);
+    if (!(suite.numberOfTasks = readPerftTasks(&suite.tasks, suite.depth))) {
+        puts("info string benchmark failed, perft_test_cases.txt could not be read");
+        return;
+    }
+    if (mb) {
+        suite.table.numberOfEntries = mb * 1024 * 1024 / sizeof(PerftEntry);
+        suite.table.entries = calloc(suite.table.numberOfEntries, sizeof(PerftEntry));
+    }
+
+    uint64_t startNs = getTimeNs();
+    for (int i = 1; i < threads; i++) pthread_create(&th[i], nullptr, runPerftTasks, &suite);
+    runPerftTasks(&suite);
+    for (int i = 1; i < threads; i++) pthread_join(th[i], nullptr);
+    double totalTime = (getTimeNs() - startNs) / 1e9;
 
-    double totalTime = 0.001; // TODO: Non ideal way to guard divide by 0 below
     uint64_t actualNodes = 0, expectedNodes = 0;
-    printf("info string benchmark starting, depth: %u\n", depth);
-    while (fgets(line, sizeof(line), perftFile)) {
-        ChessBoard board = {0};
-        ChessBoardHistory history = {0};
-        parseFEN(&board, &history, nullptr, strtok(line, ","));
-
-        clock_t start = clock(); // TODO: Consider a more accurate clock
-        actualNodes += perft(&board, depth);
-        totalTime += (double) (clock() - start) / CLOCKS_PER_SEC;
-        
-        for (int i = 0; i < depth - 1; i++) strtok(nullptr, ",");
-        expectedNodes += strtoull(strtok(nullptr, ","), nullptr, 10);
+    for (size_t i = 0; i < suite.numberOfTasks; i++) {
+        const PerftTask *task = &suite.tasks[i];
+        actualNodes += task->nodes;
+        expectedNodes += task->expectedNodes;
+        if (task->nodes != task->expectedNodes)
+            printf("info string benchmark failed on fen: %s, expected positions: %llu, positions got: %llu\n", task->fen, task->expectedNodes, task->nodes);
     }
 
     printf("info string benchmark %s, expected positions: %llu, positions got: %llu\n", expectedNodes == actualNodes ? "passed" : "failed", expectedNodes, actualNodes);
     printf("info string total time: %.2lf sec, positions/sec: %.0lf\n", totalTime, actualNodes / totalTime);
-    fclose(perftFile);
+    free(suite.table.entries);
+    free(suite.tasks);
+}
+
+static void searchBenchmark() {
+    bench(parseBenchDepth(strtok(nullptr, " ")));
 }
 
 static void eval(const Accumulator *restrict accumulator, Colour stm) {
@@ -177,34 +389,49 @@ static void train(const UCI_Configuration *restrict config) {
     startTrainingThreads(config);
 }
 
+static bool changesEngineState(const char *token) {
+    static const char *const COMMANDS[] = {GO, POSITION, SET_OPTION, UCI_NEW_GAME, BENCH, BENCHMARK, EVAL, FEN, TRAIN};
+    for (size_t i = 0; i < sizeof(COMMANDS) / sizeof(COMMANDS[0]); i++)
+        if (strcmp(token, COMMANDS[i]) == 0) return true;
+    return false;
+}
+
 void uciLoop() {
     // Default configuration
     UCI_Configuration config = {.hashSize = 16, .threads = 1};
-    parseFEN(&config.board, &histories[0], &config.accumulator, START_POS);
-    createTranspositionTable(&config.tt, config.hashSize);
+    parseFEN(&config.board, &config.accumulator, START_POS);
+    resizeTranspositionTable(&config, config.hashSize);
 
     char input[4096]; // Assumes input is large enough to hold '\n' from stdin
     char *token = nullptr;
     setvbuf(stdout, nullptr, _IONBF, 0);
     while (!token || strcmp(token, QUIT) != 0) {
-        fgets(input, sizeof(input), stdin);
+        if (!fgets(input, sizeof(input), stdin)) break;
         input[strlen(input) - 1] = '\0'; // TODO: Can remove the length check
         token = strtok(input, " ");
         if (!token) continue;
 
+        // The search runs in the background, only the commands that change what it reads wait for it to finish.
+        // Everything else is answered while it runs, so infinite analysis can always be stopped
+        if (strcmp(token, STOP) == 0 || strcmp(token, QUIT) == 0) stopSearchThreads();
+        if (changesEngineState(token)) waitForSearchThreads();
+
         // Official UCI Commands
         if      (strcmp(token, GO          ) == 0) go(&config);
         else if (strcmp(token, IS_READY    ) == 0) isReady();
         else if (strcmp(token, POSITION    ) == 0) position(&config.board, &config.accumulator);
         else if (strcmp(token, SET_OPTION  ) == 0) setOption(&config);
         else if (strcmp(token, UCI         ) == 0) uci();
-        else if (strcmp(token, UCI_NEW_GAME) == 0) uciNewGame(&config.tt);
+        else if (strcmp(token, UCI_NEW_GAME) == 0) uciNewGame(&config);
 
         // Unofficial UCI Commands
-        else if (strcmp(token, BENCHMARK) == 0) benchmark();
+        else if (strcmp(token, BENCH    ) == 0) searchBenchmark();
+        else if (strcmp(token, BENCHMARK) == 0) benchmark(config.threads);
         else if (strcmp(token, EVAL     ) == 0) eval(&config.accumulator, config.board.sideToMove);
         else if (strcmp(token, FEN      ) == 0) fen(&config.board);
         else if (strcmp(token, TRAIN    ) == 0) train(&config);
     }
+    stopSearchThreads();
+    waitForSearchThreads();
     stopTrainingThreads();
 }
@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <immintrin.h>
 
 typedef uint64_t Bitboard;
@@ -145,7 +146,7 @@ static inline Square bitboardToSquare(Bitboard b) {
 /* If multiple bits are set, returns square of Least Significant Bit and removes the LSB from pointer. Undefined for b == 0. */
 static inline Square bitboardToSquareWithReset(Bitboard *b) {
     Square sq = H1 - __builtin_ctzll(*b);
-    *b = _blsr_u64(*b);
+    *b &= *b - 1; // Compiles to blsr when BMI is available
     return sq;
 }
 
@@ -169,21 +170,44 @@ static inline int populationCount(Bitboard b) {
     return __builtin_popcountll(b);
 }
 
+#ifndef NO_PEXT
 /* Parallel Bits Extract */
 static inline uint64_t pext(uint64_t src, uint64_t mask) {
     return _pext_u64(src, mask);
 }
+#endif
 
 static inline int max(int a, int b) {
     return a >= b ? a : b;
 }
 
+static inline int min(int a, int b) {
+    return a <= b ? a : b;
+}
+
 static inline bool isAdjacentSquare(Square fromSq, Square toSq) {
     int rankDistance = abs((int) squareToRank(toSq) - (int) squareToRank(fromSq));
     int fileDistance = abs((int) squareToFile(toSq) - (int) squareToFile(fromSq));
     return max(rankDistance, fileDistance) == 1;
 }
 
+static inline void* alignedAllocate(size_t alignment, size_t size) {
+    size = (size + alignment - 1) / alignment * alignment; // Size must be a multiple of the alignment
+#ifdef _WIN32
+    return _aligned_malloc(size, alignment);
+#else
+    return aligned_alloc(alignment, size);
+#endif
+}
+
+static inline void alignedFree(void *ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
 // A PRNG that can be found here: https://arxiv.org/pdf/1402.6246
 static inline uint64_t random64BitNumber(uint64_t *restrict seed) {
     *seed ^= *seed >> 12, *seed ^= *seed << 25, *seed ^= *seed >> 27;